@@ -0,0 +1,221 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file aa.c
+ * This file contains the adaptive anti-aliasing. The image is calculated
+ * with one sample per pixel first. Then each pixel whose iteration count
+ * differs from one of its 8 neighbours by more than a threshold is
+ * calculated again with a grid of sub-samples. The colors of the sub-samples
+ * are averaged. All other pixels get the color of their single sample, thus
+ * the extra cost is proportional to the number of edge pixels only.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "intfract.h"
+
+
+typedef struct aa
+{
+   const fract_view_t *view;
+   uint32_t *rgb;
+   int stride;
+   //! number of sub-samples per side and threshold of the edge detection
+   int grid, threshold;
+   //! index of this thread and number of threads
+   int idx, nthreads;
+   //! number of edge pixels
+   long edges;
+} aa_t;
+
+
+/*! Test if a pixel lies on an edge.
+ * @param image Pointer to the pixel.
+ * @param hres Number of pixels per row.
+ * @param x Column of the pixel.
+ * @param r Row of the pixel in memory.
+ * @param vres Number of rows.
+ * @param threshold Maximum difference of the iteration counts of non-edges.
+ * @return Returns 1 if it is an edge, otherwise 0.
+ */
+static int aa_edge(const int *image, int hres, int x, int r, int vres, int threshold)
+{
+   for (int j = r > 0 ? -1 : 0; j <= (r < vres - 1 ? 1 : 0); j++)
+      for (int i = x > 0 ? -1 : 0; i <= (x < hres - 1 ? 1 : 0); i++)
+         if (abs(image[j * hres + i] - *image) > threshold)
+            return 1;
+   return 0;
+}
+
+
+/*! Return the average of the colors of the iteration counts.
+ */
+static uint32_t aa_average(const int *cnt, int n)
+{
+   unsigned r = 0, g = 0, b = 0;
+   uint32_t c;
+
+   for (int i = 0; i < n; i++)
+   {
+      c = palette_[cnt[i]];
+      r += (c >> 16) & 0xff;
+      g += (c >> 8) & 0xff;
+      b += c & 0xff;
+   }
+   return (r / n) << 16 | (g / n) << 8 | b / n;
+}
+
+
+/*! Thread function, it colors every nthreads-th row. The sub-samples of all
+ * edge pixels of a row are collected and calculated as one batch.
+ */
+static void aa_thread(void *p, int idx)
+{
+   aa_t *a = (aa_t*) p + idx;
+   const fract_view_t *v = a->view;
+   double dr = (double) (v->realmax - v->realmin) / v->hres, di = (double) (v->imagmax - v->imagmin) / v->vres;
+   int n, m, y, ns = a->grid * a->grid;
+   const int *image;
+   uint32_t *rgb;
+   nint_t *reals, *imags;
+   int *cnt, *xs;
+   long edges = 0;
+
+   if ((reals = malloc(v->hres * ns * (2 * sizeof(*reals) + sizeof(*cnt)) + v->hres * sizeof(*xs))) == NULL)
+   {
+      perror("malloc()");
+      // color the rows without anti-aliasing
+      for (int r = a->idx; r < v->vres; r += a->nthreads)
+         fract_colorize(a->rgb + a->stride * r, a->stride, v->image + v->hres * r, v->hres, v->hres, 1);
+      return;
+   }
+   imags = reals + v->hres * ns;
+   cnt = (int*) (imags + v->hres * ns);
+   xs = cnt + v->hres * ns;
+
+   for (int r = a->idx; r < v->vres; r += a->nthreads)
+   {
+      image = v->image + v->hres * r;
+      rgb = a->rgb + a->stride * r;
+      // the rows are stored bottom up
+      y = v->vres - r - 1;
+      for (int x = n = m = 0; x < v->hres; x++)
+      {
+         rgb[x] = palette_[image[x]];
+         if (!aa_edge(image + x, v->hres, x, r, v->vres, a->threshold))
+            continue;
+
+         // sub-samples evenly distributed around the sample point of the pixel
+         xs[m++] = x;
+         for (int j = 0; j < a->grid; j++)
+            for (int i = 0; i < a->grid; i++, n++)
+            {
+               reals[n] = v->realmin + (nint_t) (dr * (x + (i + 0.5) / a->grid - 0.5));
+               imags[n] = v->imagmax - (nint_t) (di * (y + (j + 0.5) / a->grid - 0.5));
+            }
+      }
+
+#ifdef WITH_SIMD
+      iterate_vec(reals, imags, cnt, n);
+#else
+      for (int i = 0; i < n; i++)
+         cnt[i] = iterate(reals[i], imags[i]);
+#endif
+      for (int i = 0; i < m; i++)
+         rgb[xs[i]] = aa_average(cnt + i * ns, ns);
+      edges += m;
+   }
+
+   free(reals);
+   a->edges = edges;
+}
+
+
+/*! Color the image with adaptive anti-aliasing. The image must be calculated
+ * already (v->image).
+ * @param v Pointer to the view.
+ * @param rgb Pointer to the destination.
+ * @param stride Number of pixels per row of rgb.
+ * @param samples Number of sub-samples of edge pixels, it is rounded down to
+ * a square.
+ * @param threshold Maximum difference of the iteration counts to the
+ * neighbours of pixels which are not sub-sampled.
+ * @param nthreads Number of threads.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int aa_render(const fract_view_t *v, uint32_t *rgb, int stride, int samples, int threshold, int nthreads)
+{
+   aa_t *a;
+   long edges = 0;
+   int grid = sqrt(samples);
+
+   // the sub-samples are calculated with iterate()
+   if (v->limbs)
+   {
+      fprintf(stderr, "anti-aliasing supports native precision only\n");
+      grid = 1;
+   }
+   if (grid < 2)
+   {
+      fract_colorize(rgb, stride, v->image, v->hres, v->hres, v->vres);
+      return 0;
+   }
+
+#ifndef WITH_THREADS
+   nthreads = 1;
+#endif
+   if (nthreads < 1)
+      nthreads = 1;
+
+   if ((a = calloc(nthreads, sizeof(*a))) == NULL)
+   {
+      perror("calloc()");
+      return -1;
+   }
+
+   for (int i = 0; i < nthreads; i++)
+   {
+      a[i].view = v;
+      a[i].rgb = rgb;
+      a[i].stride = stride;
+      a[i].grid = grid;
+      a[i].threshold = threshold;
+      a[i].idx = i;
+      a[i].nthreads = nthreads;
+   }
+
+   if (pool_run(aa_thread, a, nthreads) == -1)
+   {
+      free(a);
+      return -1;
+   }
+
+   for (int i = 0; i < nthreads; i++)
+   {
+      edges += a[i].edges;
+   }
+
+#ifdef WITH_TIME
+   fprintf(stderr, "anti-aliasing: %ld edge pixels (%.1f%%), %d samples\n", edges,
+         100.0 * edges / ((long) v->hres * v->vres), grid * grid);
+#endif
+   free(a);
+   return 0;
+}
@@ -0,0 +1,293 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file anim.c
+ * This file contains the animation mode. It renders a sequence of frames
+ * between a start and an end bbox. The width of the frames changes
+ * geometrically (i.e. with a constant zoom factor per step if the easing is
+ * linear) and the center moves proportionally to the zoom, thus the target
+ * stays at the same place of the frames.
+ *
+ * Each frame reuses the iteration counts of the previous one: a pixel takes
+ * the value of the nearest pixel of the previous frame if this one and all of
+ * its 8 neighbours have the same value. All other pixels (new areas and
+ * details) are calculated with MODE_REFINE. This is an approximation, thus
+ * the last frame is calculated completely and it is exact.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "intfract.h"
+
+
+/*! Return the eased progress of the animation.
+ * @param ease Easing curve, see EASE_LINEAR...
+ * @param t Linear progress from 0 to 1.
+ */
+static double anim_ease(int ease, double t)
+{
+   switch (ease)
+   {
+      case EASE_SMOOTH:
+         return t * t * (3 - 2 * t);
+      case EASE_IN:
+         return t * t;
+      case EASE_OUT:
+         return t * (2 - t);
+      default:
+         return t;
+   }
+}
+
+
+/*! Return the easing curve of a name.
+ * @return Returns the easing curve or -1 if the name is unknown.
+ */
+int anim_ease_by_name(const char *s)
+{
+   static const char *name[] = {"linear", "smooth", "in", "out"};
+
+   for (int i = 0; i < NUM_EASE; i++)
+      if (!strcmp(s, name[i]))
+         return i;
+   return -1;
+}
+
+
+/*! Interpolate the bbox of a frame.
+ * @param b Pointer to array of 4 doubles which receives the bbox.
+ * @param b0 Start bbox (realmin, imagmin, realmax, imagmax).
+ * @param b1 End bbox.
+ * @param s Eased progress from 0 to 1.
+ */
+static void anim_bbox(double *b, const double *b0, const double *b1, double s)
+{
+   double w0 = b0[2] - b0[0], w1 = b1[2] - b1[0], h0 = b0[3] - b0[1], w, h, p;
+
+   // hit the end bbox exactly
+   if (s >= 1)
+   {
+      memcpy(b, b1, 4 * sizeof(*b));
+      return;
+   }
+
+   // geometric interpolation of the width
+   w = w0 > 0 && w1 > 0 ? w0 * pow(w1 / w0, s) : w0 + (w1 - w0) * s;
+   h = h0 * w / w0;
+   // the center follows the zoom
+   p = w0 != w1 ? (w0 - w) / (w0 - w1) : s;
+
+   for (int i = 0; i < 2; i++)
+   {
+      double c = (b0[i] + b0[i + 2]) / 2 + ((b1[i] + b1[i + 2]) - (b0[i] + b0[i + 2])) / 2 * p;
+      double d = (i ? h : w) / 2;
+      b[i] = c - d;
+      b[i + 2] = c + d;
+   }
+}
+
+
+/*! Take over the pixels of the previous frame which lie in flat areas. All
+ * other pixels are set to -1.
+ * @param v Pointer to the view of the new frame.
+ * @param b Bbox of the new frame.
+ * @param prev Iteration counts of the previous frame.
+ * @param p Bbox of the previous frame.
+ * @return Returns the number of pixels which were taken over.
+ */
+static long anim_reuse(const fract_view_t *v, const double *b, const int *prev, const double *p)
+{
+   double ax, bx, ay, by;
+   int x, y, ox, oy, i, j, c, hres = v->hres, vres = v->vres;
+   long n = 0;
+
+   // pixel (x, y) of the new frame is at (ax * x + bx, ay * y + by) in the previous frame
+   ax = (b[2] - b[0]) / (p[2] - p[0]);
+   bx = (b[0] - p[0]) / (p[2] - p[0]) * hres;
+   ay = (b[3] - b[1]) / (p[3] - p[1]);
+   by = (p[3] - b[3]) / (p[3] - p[1]) * vres;
+
+   for (y = 0; y < vres; y++)
+   {
+      oy = lround(ay * y + by);
+      for (x = 0; x < hres; x++)
+      {
+         v->image[x + hres * (vres - y - 1)] = -1;
+         ox = lround(ax * x + bx);
+         if (ox < 1 || ox >= hres - 1 || oy < 1 || oy >= vres - 1)
+            continue;
+
+         c = prev[ox + hres * (vres - oy - 1)];
+         for (j = -1; j <= 1; j++)
+            for (i = -1; i <= 1; i++)
+               if (prev[ox + i + hres * (vres - oy - j - 1)] != c)
+                  goto anim_next;
+
+         v->image[x + hres * (vres - y - 1)] = c;
+         n++;
+anim_next:
+         ;
+      }
+   }
+
+   return n;
+}
+
+
+/*! Write a frame as raw RGB data.
+ */
+static void anim_write_raw(const int *image, int hres, int vres, FILE *f)
+{
+   unsigned char *row;
+   uint32_t c;
+
+   if ((row = malloc(hres * 3)) == NULL)
+   {
+      perror("malloc()");
+      return;
+   }
+
+   for (int y = 0; y < vres; y++)
+   {
+      for (int x = 0; x < hres; x++, image++)
+      {
+         c = palette_[*image];
+         row[3 * x] = c >> 16;
+         row[3 * x + 1] = c >> 8;
+         row[3 * x + 2] = c;
+      }
+      if (fwrite(row, hres * 3, 1, f) != 1)
+      {
+         perror("fwrite()");
+         break;
+      }
+   }
+
+   free(row);
+}
+
+
+/*! Test if a file name is a printf-style format with exactly one integer
+ * conversion for the frame number, i.e. "%[flags][width]d" or "i". Any "%%"
+ * is a literal '%'.
+ * @return Returns 1 if it is such a format, otherwise 0.
+ */
+static int anim_pattern(const char *s)
+{
+   int n = 0;
+
+   for (; (s = strchr(s, '%')) != NULL; s++)
+   {
+      if (*++s == '%')
+         continue;
+      s += strspn(s, "0-+ #");
+      s += strspn(s, "0123456789");
+      if ((*s != 'd' && *s != 'i') || n++)
+         return 0;
+   }
+
+   return n == 1;
+}
+
+
+/*! Render an animation.
+ * @param v Pointer to view. The members hres, vres and mode must be set, the
+ * others are overwritten.
+ * @param b0 Start bbox (realmin, imagmin, realmax, imagmax).
+ * @param b1 End bbox.
+ * @param frames Number of frames.
+ * @param ease Easing curve.
+ * @param nthreads Number of threads.
+ * @param out Name of the output files. It may contain a printf-style format
+ * for the frame number (e.g. "frame%04d.png", see anim_pattern()), otherwise
+ * the frame number is inserted before the extension. If it is "-", raw RGB frames are written to
+ * stdout.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int anim_render(fract_view_t *v, const double *b0, const double *b1, int frames, int ease, int nthreads, const char *out)
+{
+   double b[4], p[4];
+   int *img, *prev, *t, mode = v->mode, pattern = anim_pattern(out);
+   char name[1024];
+   const char *ext;
+   long n;
+
+   if ((img = malloc(2 * v->hres * v->vres * sizeof(*img))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   prev = img + v->hres * v->vres;
+
+   for (int f = 0; f < frames; f++)
+   {
+      anim_bbox(b, b0, b1, anim_ease(ease, frames > 1 ? (double) f / (frames - 1) : 0));
+      v->realmin = b[0] * NORM_FACT;
+      v->imagmin = b[1] * NORM_FACT;
+      v->realmax = b[2] * NORM_FACT;
+      v->imagmax = b[3] * NORM_FACT;
+      v->image = img;
+
+      if (f && f < frames - 1)
+      {
+         n = anim_reuse(v, b, prev, p);
+         v->mode = MODE_REFINE;
+      }
+      else
+      {
+         n = 0;
+         v->mode = mode;
+      }
+      if (sched_render(v, 0, v->vres, nthreads) == -1)
+      {
+         v->image = NULL;
+         free(img < prev ? img : prev);
+         return -1;
+      }
+#ifdef WITH_TIME
+      fprintf(stderr, "frame %d: %.1f%% reused\n", f, n * 100.0 / ((long) v->hres * v->vres));
+#endif
+
+      if (!strcmp(out, "-"))
+         anim_write_raw(img, v->hres, v->vres, stdout);
+      else
+      {
+         if (pattern)
+            snprintf(name, sizeof(name), out, f);
+         else
+         {
+            if ((ext = strrchr(out, '.')) == NULL)
+               ext = out + strlen(out);
+            snprintf(name, sizeof(name), "%.*s%04d%s", (int) (ext - out), out, f, ext);
+         }
+         cairo_save_image(img, v->hres, v->vres, name);
+      }
+
+      t = prev;
+      prev = img;
+      img = t;
+      memcpy(p, b, sizeof(p));
+   }
+
+   v->image = NULL;
+   free(img < prev ? img : prev);
+   return 0;
+}
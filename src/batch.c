@@ -0,0 +1,413 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file batch.c
+ * This file contains the batch mode (option -b). It renders the jobs of a
+ * manifest in a single process. Each line of the manifest is one job:
+ *
+ *    <output> <width> <height> <maxiterate|auto> <colset> <x0> <y0> <x1> <y1>
+ *
+ * Empty lines and lines starting with '#' are skipped. The jobs are rendered
+ * asynchronously in a few slots which keep their image buffers and palettes
+ * from job to job. Further jobs are started as long as less than BATCH_TILES
+ * tiles per thread are rendered, thus small jobs are packed together to keep
+ * all threads busy. The images are written in the order of the manifest while
+ * the following jobs are rendered. The timings of each job are written as a
+ * JSON object per line to stdout.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cairo.h>
+
+#include "intfract.h"
+
+
+//! maximum number of jobs in flight
+#define BATCH_SLOTS 8
+//! jobs are started while less than this number of tiles per thread are rendered
+#define BATCH_TILES 4
+
+enum {SLOT_RENDER, SLOT_DONE};
+
+struct batch;
+
+typedef struct batch_slot
+{
+   //! back pointer to the batch
+   struct batch *batch;
+   //! SLOT_RENDER or SLOT_DONE, it is set by the pool
+   int state;
+   //! number of the job and line of the manifest
+   int job, line;
+   char out[1024];
+   fract_view_t view;
+   //! image buffer, it is reused by the following jobs of the slot
+   uint32_t *rgb;
+   size_t size;
+   //! palette of colset and maxiterate, it is reused as well
+   uint32_t *palette;
+   int colset, maxiterate;
+   //! number of tiles of the job
+   int ntiles;
+   //! times of the start, the end of the setup and the end of the render
+   double t0, t1, t2;
+   double imbalance;
+} batch_slot_t;
+
+typedef struct batch
+{
+#ifdef WITH_THREADS
+   pthread_mutex_t mutex;
+   //! signaled if a job is finished
+   pthread_cond_t cond;
+#endif
+   batch_slot_t slot[BATCH_SLOTS];
+   //! index of the oldest job in flight and number of jobs in flight
+   int head, cnt;
+   //! manifest
+   FILE *f;
+   int eof;
+   //! number of the current line, number of jobs and number of failed jobs
+   int line, njobs, failed;
+   //! options of the command line
+   int cc, limbs, direct, mode, nthreads;
+} batch_t;
+
+
+/*! Return monotonic time in seconds.
+ */
+static double batch_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Write a string as JSON string.
+ */
+static void batch_str(const char *s)
+{
+   putchar('"');
+   for (; *s; s++)
+      if (*s == '"' || *s == '\\')
+         printf("\\%c", *s);
+      else if ((unsigned char) *s < ' ')
+         printf("\\u%04x", *s);
+      else
+         putchar(*s);
+   putchar('"');
+}
+
+
+/*! Report a job which failed.
+ */
+static void batch_error(batch_t *b, const char *out, const char *err)
+{
+   b->failed++;
+   printf("{\"job\": %d, \"line\": %d, \"out\": ", b->njobs, b->line);
+   batch_str(out);
+   printf(", \"status\": \"error\", \"error\": ");
+   batch_str(err);
+   printf("}\n");
+   fflush(stdout);
+}
+
+
+/*! Called by the thread of the pool which finishes a job.
+ */
+static void batch_done(void *p, double imbalance)
+{
+   batch_slot_t *sl = p;
+
+   sl->t2 = batch_time();
+   sl->imbalance = imbalance;
+#ifdef WITH_THREADS
+   pthread_mutex_lock(&sl->batch->mutex);
+   sl->state = SLOT_DONE;
+   pthread_cond_signal(&sl->batch->cond);
+   pthread_mutex_unlock(&sl->batch->mutex);
+#else
+   sl->state = SLOT_DONE;
+#endif
+}
+
+
+/*! Read the next job of the manifest and start it in a slot.
+ * @return Returns 1 if a job was started, or 0 at the end of the manifest.
+ */
+static int batch_start(batch_t *b, batch_slot_t *sl)
+{
+   char buf[2048], iter[32], sb[4][64];
+   const char *sbbox[] = {sb[0], sb[1], sb[2], sb[3]};
+   fract_view_t *v = &sl->view;
+   int w, h, colset, autoit;
+   size_t size;
+
+   while (fgets(buf, sizeof(buf), b->f) != NULL)
+   {
+      b->line++;
+      if (buf[strspn(buf, " \t\r\n")] == '\0' || buf[strspn(buf, " \t")] == '#')
+         continue;
+
+      b->njobs++;
+      sl->t0 = batch_time();
+      if (sscanf(buf, "%1023s %d %d %31s %d %63s %63s %63s %63s", sl->out, &w, &h, iter, &colset,
+               sb[0], sb[1], sb[2], sb[3]) != 9)
+      {
+         buf[strcspn(buf, "\r\n")] = '\0';
+         batch_error(b, buf, "invalid job");
+         continue;
+      }
+      autoit = !strcmp(iter, "auto");
+      maxiterate_ = autoit ? MAXITERATE : atoi(iter);
+      if (w <= 0 || h <= 0 || maxiterate_ <= 0 || colset < 0 || colset >= NUM_COLSET)
+      {
+         batch_error(b, sl->out, "invalid size, iterations or color set");
+         continue;
+      }
+      // stdout receives the timings
+      if (!strcmp(sl->out, "-"))
+      {
+         batch_error(b, sl->out, "output to stdout is not supported");
+         continue;
+      }
+
+      // the limit is chosen before the reference orbit is calculated
+      memset(v, 0, sizeof(*v));
+      v->hres = w;
+      v->vres = h;
+      v->mode = b->mode;
+      if (view_setup(v, sbbox, b->cc, b->limbs, b->direct || autoit) == -1 || (autoit && maxiter_auto(v, b->direct) == -1))
+      {
+         perturb_free(v);
+         batch_error(b, sl->out, "setup failed");
+         continue;
+      }
+
+      size = (size_t) w * h * sizeof(*sl->rgb);
+      if (size > sl->size)
+      {
+         topo_free(sl->rgb, sl->size);
+         sl->size = 0;
+         if ((sl->rgb = topo_alloc(size)) == NULL)
+         {
+            perturb_free(v);
+            batch_error(b, sl->out, "out of memory");
+            continue;
+         }
+         sl->size = size;
+      }
+      if (sl->palette == NULL || sl->colset != colset || sl->maxiterate != maxiterate_)
+      {
+         free(sl->palette);
+         sl->colset = colset;
+         sl->maxiterate = maxiterate_;
+         if ((sl->palette = palette_create(colset)) == NULL)
+         {
+            perturb_free(v);
+            batch_error(b, sl->out, "out of memory");
+            continue;
+         }
+      }
+      // the pool takes over the parameters of this thread
+      colset_ = colset;
+      palette_ = sl->palette;
+      v->rgb = sl->rgb;
+      v->stride = w;
+
+      sl->batch = b;
+      sl->job = b->njobs;
+      sl->line = b->line;
+      sl->ntiles = ((w + TILE_SIZE - 1) / TILE_SIZE) * ((h + TILE_SIZE - 1) / TILE_SIZE);
+      sl->state = SLOT_RENDER;
+      sl->t1 = batch_time();
+      if (sched_start(v, b->nthreads, batch_done, sl) == -1)
+      {
+         perturb_free(v);
+         batch_error(b, sl->out, "render failed");
+         continue;
+      }
+      return 1;
+   }
+
+   b->eof = 1;
+   return 0;
+}
+
+
+/*! Start jobs as long as there are free slots and the threads need more
+ * tiles.
+ */
+static void batch_fill(batch_t *b)
+{
+   int ntiles;
+
+   while (!b->eof && b->cnt < BATCH_SLOTS)
+   {
+      ntiles = 0;
+#ifdef WITH_THREADS
+      pthread_mutex_lock(&b->mutex);
+#endif
+      for (int i = 0; i < b->cnt; i++)
+         if (b->slot[(b->head + i) % BATCH_SLOTS].state == SLOT_RENDER)
+            ntiles += b->slot[(b->head + i) % BATCH_SLOTS].ntiles;
+#ifdef WITH_THREADS
+      pthread_mutex_unlock(&b->mutex);
+#endif
+      if (ntiles >= BATCH_TILES * b->nthreads)
+         break;
+
+      b->cnt += batch_start(b, &b->slot[(b->head + b->cnt) % BATCH_SLOTS]);
+   }
+}
+
+
+/*! Write the image of a finished job and report its timings.
+ */
+static void batch_write(batch_t *b, batch_slot_t *sl)
+{
+   cairo_surface_t *sfc;
+   const char *err = NULL;
+   double t3, t4;
+
+   t3 = batch_time();
+   // the image of a failed render is not written
+   if (sl->imbalance < 0)
+      err = "render failed";
+   else
+   {
+      sfc = cairo_image_surface_create_for_data((unsigned char*) sl->rgb, CAIRO_FORMAT_RGB24, sl->view.hres, sl->view.vres,
+            sl->view.hres * sizeof(*sl->rgb));
+      if (cairo_write_surface(sfc, sl->out) == -1)
+         err = "write failed";
+      cairo_surface_destroy(sfc);
+   }
+   t4 = batch_time();
+   perturb_free(&sl->view);
+
+   if (err != NULL)
+   {
+      b->failed++;
+      printf("{\"job\": %d, \"line\": %d, \"out\": ", sl->job, sl->line);
+      batch_str(sl->out);
+      printf(", \"status\": \"error\", \"error\": ");
+      batch_str(err);
+      printf("}\n");
+      fflush(stdout);
+      return;
+   }
+
+   printf("{\"job\": %d, \"line\": %d, \"out\": ", sl->job, sl->line);
+   batch_str(sl->out);
+   printf(", \"status\": \"ok\", \"hres\": %d, \"vres\": %d, \"maxiterate\": %d, \"limbs\": %d, "
+         "\"setup_s\": %.6f, \"render_s\": %.6f, \"write_s\": %.6f, \"total_s\": %.6f, \"imbalance\": %.4f}\n",
+         sl->view.hres, sl->view.vres, sl->maxiterate, sl->view.limbs,
+         sl->t1 - sl->t0, sl->t2 - sl->t1, t4 - t3, t4 - sl->t0, sl->imbalance);
+   fflush(stdout);
+}
+
+
+/*! Render all jobs of a manifest.
+ * @param manifest Name of the manifest, "-" for stdin.
+ * @param cc 1 if the jobs contain center and width/height.
+ * @param limbs Precision, see view_setup().
+ * @param direct 1 to iterate every pixel in multi-precision.
+ * @param mode Render mode.
+ * @param nthreads Number of threads.
+ * @return Returns 0 if all jobs were written, otherwise -1.
+ */
+int batch_run(const char *manifest, int cc, int limbs, int direct, int mode, int nthreads)
+{
+   fract_param_t save;
+   batch_t *b;
+   batch_slot_t *sl;
+   int ret;
+
+   if ((b = calloc(1, sizeof(*b))) == NULL)
+   {
+      perror("calloc()");
+      return -1;
+   }
+   if (!strcmp(manifest, "-"))
+      b->f = stdin;
+   else if ((b->f = fopen(manifest, "r")) == NULL)
+   {
+      fprintf(stderr, "failed to open manifest %s\n", manifest);
+      free(b);
+      return -1;
+   }
+
+   b->cc = cc;
+   b->limbs = limbs;
+   b->direct = direct;
+   b->mode = mode;
+   b->nthreads = nthreads < 1 ? 1 : nthreads;
+#ifdef WITH_THREADS
+   pthread_mutex_init(&b->mutex, NULL);
+   pthread_cond_init(&b->cond, NULL);
+#endif
+
+   param_get(&save);
+#ifdef WITH_TIME
+   double t = batch_time();
+#endif
+   for (;;)
+   {
+      batch_fill(b);
+      if (!b->cnt)
+         break;
+
+      // wait for the oldest job, the next ones are started before it is written
+      sl = &b->slot[b->head];
+#ifdef WITH_THREADS
+      pthread_mutex_lock(&b->mutex);
+      while (sl->state != SLOT_DONE)
+         pthread_cond_wait(&b->cond, &b->mutex);
+      pthread_mutex_unlock(&b->mutex);
+#endif
+      batch_fill(b);
+      batch_write(b, sl);
+      b->head = (b->head + 1) % BATCH_SLOTS;
+      b->cnt--;
+   }
+   param_set(&save);
+
+#ifdef WITH_TIME
+   fprintf(stderr, "batch: %d jobs, %d failed, %.3fs\n", b->njobs, b->failed, batch_time() - t);
+#endif
+
+   for (int i = 0; i < BATCH_SLOTS; i++)
+   {
+      topo_free(b->slot[i].rgb, b->slot[i].size);
+      free(b->slot[i].palette);
+   }
+#ifdef WITH_THREADS
+   pthread_mutex_destroy(&b->mutex);
+   pthread_cond_destroy(&b->cond);
+#endif
+   if (b->f != stdin)
+      fclose(b->f);
+   ret = b->failed ? -1 : 0;
+   free(b);
+   return ret;
+}
@@ -0,0 +1,309 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file bench.c
+ * This file contains the benchmark suite (option -B, make bench). It renders
+ * a fixed set of standard views with every kernel of the build (see kernel.c)
+ * in full and in Mariani-Silver mode. Each run is repeated and the median is
+ * reported together with the number of iterations per second, the time per
+ * iteration and the load imbalance of the threads. If the kernel allows it
+ * (perf_event_open(2)), the hardware counters for cycles, instructions and
+ * branch misses are read as well. The result is written as JSON to stdout.
+ *
+ * The number of iterations is the sum of the iteration counts of all pixels,
+ * i.e. the work of a plain calculation. Shortcuts (interior checks,
+ * Mariani-Silver) thus increase the rate.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "intfract.h"
+
+
+//! maximum number of kernel combinations
+#define BENCH_MAX_KERNEL 16
+
+//! standard view of the benchmark
+typedef struct bench_view
+{
+   const char *name;
+   //! realmin, imagmin, realmax, imagmax
+   double bbox[4];
+   int hres, vres, maxiterate;
+} bench_view_t;
+
+static const bench_view_t bench_view_[] =
+{
+   {"shallow", {-2.0, -1.2, 0.7, 1.2}, 640, 400, 256},
+   {"seahorse", {-0.75, 0.1, -0.74, 0.11}, 640, 400, 2000},
+   {"interior", {-0.25, 0.6, 0.0, 0.85}, 640, 400, 10000},
+   // the setup of the benchmark in the README
+   {"readme", {-2.0, -1.2, 0.7, 1.2}, 640, 400, 50000},
+};
+
+#define NUM_BENCH_VIEW (sizeof(bench_view_) / sizeof(*bench_view_))
+
+//! hardware counters
+static const struct
+{
+   const char *name;
+   uint64_t config;
+} bench_ctr_[] =
+{
+   {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+   {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+   {"branch_misses", PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+#define NUM_BENCH_CTR (sizeof(bench_ctr_) / sizeof(*bench_ctr_))
+
+
+/*! Open a hardware counter of this process which also counts the threads
+ * started later.
+ * @return Returns the file descriptor or -1 if it is not available.
+ */
+static int bench_perf_open(uint64_t config)
+{
+   struct perf_event_attr pe;
+
+   memset(&pe, 0, sizeof(pe));
+   pe.type = PERF_TYPE_HARDWARE;
+   pe.size = sizeof(pe);
+   pe.config = config;
+   pe.disabled = 1;
+   pe.inherit = 1;
+   pe.exclude_kernel = 1;
+   pe.exclude_hv = 1;
+
+   return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+
+/*! Return monotonic time in seconds.
+ */
+static double bench_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static int bench_cmp(const void *a, const void *b)
+{
+   double d = *(const double*) a - *(const double*) b;
+
+   return d < 0 ? -1 : d > 0;
+}
+
+
+/*! Return the median of an array, the array is sorted.
+ */
+static double bench_median(double *v, int n)
+{
+   qsort(v, n, sizeof(*v), bench_cmp);
+   return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+
+/*! Render a view once.
+ * @param fd Array of the counter file descriptors.
+ * @param ctr Array which receives the counter values.
+ * @return Returns the time in seconds.
+ */
+static double bench_render(fract_view_t *v, int nthreads, const int *fd, double *ctr, double *imbalance)
+{
+   uint64_t val;
+   double t;
+
+   for (unsigned i = 0; i < NUM_BENCH_CTR; i++)
+      if (fd[i] != -1)
+      {
+         ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+         ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+      }
+
+   t = bench_time();
+   *imbalance = sched_render(v, 0, v->vres, nthreads);
+   t = bench_time() - t;
+
+   for (unsigned i = 0; i < NUM_BENCH_CTR; i++)
+      if (fd[i] != -1)
+      {
+         ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+         ctr[i] = read(fd[i], &val, sizeof(val)) == sizeof(val) ? val : -1;
+      }
+
+   return t;
+}
+
+
+/*! Run the benchmark and write the results as JSON to stdout.
+ * @param runs Number of runs per view and kernel.
+ * @param kernel Kernels to benchmark as given to kernel_init() or NULL for
+ * all kernels of the build.
+ * @param nthreads Number of threads.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int bench_run(int runs, const char *kernel, int nthreads)
+{
+   static const char *mode[] = {"full", "mariani"};
+   char combo[BENCH_MAX_KERNEL][64];
+   int cnarrow[BENCH_MAX_KERNEL] = {0};
+   const char *name, *scalar = NULL, *scalar32 = NULL;
+   fract_view_t v;
+   double *t, *imb, *ctr, c[NUM_BENCH_CTR], med, m;
+   int fd[NUM_BENCH_CTR], ncombo = 0, vec, narrow, p, maxiter = maxiterate_, first = 1;
+   unsigned long sum;
+
+   if (runs < 1)
+      runs = 1;
+
+   // every scalar kernel and every batch kernel together with the first scalar one
+   if (kernel != NULL)
+   {
+      // all 32 bit kernels end with "-int32"
+      cnarrow[ncombo] = strstr(kernel, "-int32") != NULL;
+      snprintf(combo[ncombo++], sizeof(*combo), "%s", kernel);
+   }
+   else
+      for (int i = 0; (name = kernel_get(i, &vec, &narrow)) != NULL && ncombo < BENCH_MAX_KERNEL; i++)
+      {
+         if (!*name)
+            continue;
+         // the 32 bit kernels are given with a set of kernels of nint_t to avoid the calibration
+         if (narrow)
+         {
+            if (!vec)
+               scalar32 = name;
+#ifdef WITH_SIMD
+            snprintf(combo[ncombo], sizeof(*combo), "%s,scalar,%s,%s", scalar, scalar32, vec ? name : "scalar");
+#else
+            snprintf(combo[ncombo], sizeof(*combo), "%s,%s", scalar, scalar32);
+#endif
+            cnarrow[ncombo++] = 1;
+         }
+         else if (!vec)
+         {
+            if (scalar == NULL)
+               scalar = name;
+#ifdef WITH_SIMD
+            snprintf(combo[ncombo++], sizeof(*combo), "%s,scalar", name);
+#else
+            snprintf(combo[ncombo++], sizeof(*combo), "%s", name);
+#endif
+         }
+         else if (strcmp(name, "scalar"))
+            snprintf(combo[ncombo++], sizeof(*combo), "%s,%s", scalar, name);
+      }
+
+   // time, imbalance and the counters of each run
+   if ((t = malloc(runs * (NUM_BENCH_CTR + 2) * sizeof(*t))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   imb = t + runs;
+   ctr = imb + runs;
+
+   for (unsigned j = 0; j < NUM_BENCH_CTR; j++)
+      fd[j] = bench_perf_open(bench_ctr_[j].config);
+
+#ifdef USE_DOUBLE
+   printf("{\n  \"double\": true,\n  \"norm_bits\": %d,\n", NORM_BITS);
+#else
+   printf("{\n  \"double\": false,\n  \"norm_bits\": %d,\n", NORM_BITS);
+#endif
+   printf("  \"threads\": %d,\n  \"runs\": %d,\n  \"results\": [", nthreads, runs);
+
+   for (unsigned i = 0; i < NUM_BENCH_VIEW; i++)
+   {
+      const bench_view_t *b = &bench_view_[i];
+
+      memset(&v, 0, sizeof(v));
+      v.hres = b->hres;
+      v.vres = b->vres;
+      v.realmin = b->bbox[0] * NORM_FACT;
+      v.imagmin = b->bbox[1] * NORM_FACT;
+      v.realmax = b->bbox[2] * NORM_FACT;
+      v.imagmax = b->bbox[3] * NORM_FACT;
+      if ((v.image = malloc(v.hres * v.vres * sizeof(*v.image))) == NULL)
+      {
+         perror("malloc()");
+         break;
+      }
+      maxiterate_ = b->maxiterate;
+
+      for (int k = 0; k < ncombo; k++)
+      {
+         if (kernel_init(combo[k]) == -1)
+            continue;
+         kernel_narrow(cnarrow[k]);
+
+         for (v.mode = MODE_FULL; v.mode <= MODE_MARIANI; v.mode++)
+         {
+            // warm up caches and clock frequency
+            bench_render(&v, nthreads, fd, c, &med);
+            for (int r = 0; r < runs; r++)
+            {
+               t[r] = bench_render(&v, nthreads, fd, c, &imb[r]);
+               for (unsigned j = 0; j < NUM_BENCH_CTR; j++)
+                  ctr[j * runs + r] = fd[j] != -1 ? c[j] : -1;
+            }
+
+            for (sum = 0, p = 0; p < v.hres * v.vres; p++)
+               sum += v.image[p];
+            med = bench_median(t, runs);
+
+            printf("%s\n    {\"view\": \"%s\", \"hres\": %d, \"vres\": %d, \"maxiterate\": %d, \"kernel\": \"%s\", \"mode\": \"%s\",\n"
+                  "     \"median_s\": %.6f, \"min_s\": %.6f, \"max_s\": %.6f, \"iterations\": %lu, \"iterations_per_s\": %.4g, \"ns_per_iteration\": %.4f, \"imbalance\": %.4f",
+                  first ? "" : ",", b->name, b->hres, b->vres, b->maxiterate, combo[k], mode[v.mode],
+                  med, t[0], t[runs - 1], sum, med > 0 ? sum / med : 0, sum ? med * 1e9 / sum : 0, bench_median(imb, runs));
+            for (unsigned j = 0; j < NUM_BENCH_CTR; j++)
+            {
+               m = bench_median(ctr + j * runs, runs);
+               if (fd[j] != -1 && m >= 0)
+                  printf(", \"%s\": %.0f", bench_ctr_[j].name, m);
+               else
+                  printf(", \"%s\": null", bench_ctr_[j].name);
+            }
+            printf("}");
+            fflush(stdout);
+            first = 0;
+         }
+      }
+      free(v.image);
+   }
+   printf("\n  ]\n}\n");
+
+   for (unsigned j = 0; j < NUM_BENCH_CTR; j++)
+      if (fd[j] != -1)
+         close(fd[j]);
+   free(t);
+   maxiterate_ = maxiter;
+
+   return 0;
+}
@@ -25,25 +25,34 @@
 //! Define to compile with thread support.
 #define WITH_THREADS
 
-//! Define to use a double precision multiplication implemented in assembler, this is the single-operand variant of imul. This uses slightly more instructions. It will also be used in the C variante of iterate() unless the following macro GCCMUL128 is defined.
+//! Define to use a double precision multiplication implemented in assembler, this is the single-operand variant of imul. This uses slightly more instructions. The C kernels are compiled with this multiplication (c-imul128) and with the 128 bit integer type of gcc (c-int128).
 #define WITH_IMUL128
 
-//! Define this to use a pure but sub-optimal C implementation of the 128 bit multiplication.
-//#define GCCMUL128
+//! Define to compile the pinning of the threads of the pool to the CPUs of the process (option -t, see topo.c). The first hardware threads of the cores are used first.
+#define WITH_AFFINITY
 
-//! Define to compile with assembler iterate() function.
+//! Define to compile the assembler kernels of iterate() (asm and asm-stack).
 #define ASM_ITERATE
 
 //! Define to use double (floating point operations), otherwise integer arithmetics is used.
 //#define USE_DOUBLE
 
-//! Define to use conservative stack-variable-solution. This is only effective if ASM_ITERATE is defined.
-//#define CONSERVATIVE
+//! Define to use the SIMD batch kernels of iterate_vec() which calculate several pixels in parallel: AVX2 or AVX-512 if USE_DOUBLE is defined, AVX-512 IFMA for the integer variant with WITH_IMUL128. The kernels which are supported by the CPU are detected at runtime (see kernel.c). Without a suitable CPU it falls back to iterate().
+#define WITH_SIMD
 
-//! Define to use instruction "enter" for function prolog. This is only effective if CONSERVATIVE is defined.
+//! Define to compile the interior checks into iterate(): points within the main cardioid or the period-2 bulb are detected before the loop, and periodic orbits are detected within the loop (Brent's algorithm). They can be switched off at runtime with option -p. The kernel asm-stack does not support it.
+#define WITH_INTERIOR
+
+//! Define to compile the instrumentation (see stats.c): per-thread counters of pixels, iterations and escape counts in mand_calc() and timings of the phases compute, colorize, encode and write. The report is printed to stderr or written as JSON with option -J. If undefined it costs nothing.
+//#define WITH_STATS
+
+//! Default threshold of the anti-aliasing (option -a): pixels whose iteration count differs by more than this from one of their neighbours are sub-sampled.
+#define AA_THRESHOLD 2
+
+//! Define to use instruction "enter" for function prolog of the kernel asm-stack.
 //#define WITH_ENTER
 
-//! Define to use instruction "leave" for function epilog. This is only effective if CONSERVATIVE is defined.
+//! Define to use instruction "leave" for function epilog of the kernel asm-stack.
 //#define WITH_LEAVE
 
 #endif
@@ -0,0 +1,628 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file dist.c
+ * This file contains the distributed rendering. A coordinator (option -P)
+ * splits the image into bands and sends them to worker processes (option -W
+ * or --worker). The workers may be local processes connected through pipes
+ * to their stdin/stdout, arbitrary commands (e.g. "ssh host intfract
+ * --worker") or workers listening on a Unix or TCP socket. The results are
+ * merged into the iteration map (-w) as they arrive and are streamed in
+ * order into the PNG file.
+ *
+ * Every worker gets one band at a time. If a worker dies, its band is
+ * assigned to another worker. If there are no more open bands, idle workers
+ * additionally calculate bands which take much longer than the average
+ * (slow workers), the first result wins.
+ *
+ * The protocol consists of frames of a header (dist_hdr_t) followed by len
+ * bytes of payload. The coordinator sends the view (DIST_VIEW) once and then
+ * the bands (DIST_BAND), the worker answers each band with DIST_RESULT which
+ * contains the iteration counts. All numbers are in host byte order, thus the
+ * machines must have the same byte order.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "intfract.h"
+
+
+#define DIST_MAGIC 0x31524649
+//! maximum number of workers
+#define DIST_MAX_WORKERS 256
+//! minimum time in seconds before a band is calculated a second time
+#define DIST_TIMEOUT 1.0
+//! a band is slow if it takes DIST_SLOW times longer than the average
+#define DIST_SLOW 3
+
+//! frame types
+enum {DIST_VIEW, DIST_BAND, DIST_RESULT};
+
+typedef struct dist_hdr
+{
+   uint32_t magic, type;
+   //! length of the payload
+   uint32_t len;
+   //! number of the band
+   uint32_t id;
+} dist_hdr_t;
+
+//! parameters of the view, see view_setup()
+typedef struct dist_view
+{
+   uint32_t hres, vres, maxiterate, interior, limbs, mode, direct, cc;
+   //! formula, see formula_init()
+   uint32_t formula, julia;
+   nint_t julia_real, julia_imag;
+   char bbox[4][64];
+} dist_view_t;
+
+//! band of PNG rows r0 to r1 - 1, in DIST_RESULT followed by the counts
+typedef struct dist_band
+{
+   uint32_t r0, r1;
+} dist_band_t;
+
+//! connection of the coordinator to a worker
+typedef struct dist_conn
+{
+   int rfd, wfd;
+   //! process id of a local worker or 0
+   pid_t pid;
+   //! band which is calculated, -1 if idle, -2 if the worker is dead
+   int band;
+   //! start time of the band
+   double t0;
+} dist_conn_t;
+
+
+/*! Return monotonic time in seconds.
+ */
+static double dist_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Read exactly len bytes.
+ * @return Returns 0 on success, or -1 on error or end of file.
+ */
+static int dist_read(int fd, void *buf, size_t len)
+{
+   ssize_t n;
+
+   for (; len; len -= n, buf = (char*) buf + n)
+      if ((n = read(fd, buf, len)) <= 0)
+         return -1;
+   return 0;
+}
+
+
+/*! Write exactly len bytes.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int dist_write(int fd, const void *buf, size_t len)
+{
+   ssize_t n;
+
+   for (; len; len -= n, buf = (const char*) buf + n)
+      if ((n = write(fd, buf, len)) <= 0)
+         return -1;
+   return 0;
+}
+
+
+/*! Send a frame. The payload consists of up to two parts.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int dist_send(int fd, int type, int id, const void *p, size_t len, const void *p2, size_t len2)
+{
+   dist_hdr_t h = {DIST_MAGIC, type, len + len2, id};
+
+   if (dist_write(fd, &h, sizeof(h)) || dist_write(fd, p, len) || (len2 && dist_write(fd, p2, len2)))
+      return -1;
+   return 0;
+}
+
+
+/*! Serve a coordinator until it closes the connection.
+ * @param rfd File descriptor to read from.
+ * @param wfd File descriptor to write to.
+ * @param nthreads Number of threads.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int dist_serve(int rfd, int wfd, int nthreads)
+{
+   fract_view_t v;
+   dist_view_t dv;
+   dist_band_t b;
+   dist_hdr_t h;
+   const char *sbbox[4];
+   int *buf = NULL, *p, ret = 0, setup = 0;
+
+   memset(&v, 0, sizeof(v));
+   while (!dist_read(rfd, &h, sizeof(h)))
+   {
+      if (h.magic != DIST_MAGIC)
+      {
+         fprintf(stderr, "worker: protocol error\n");
+         ret = -1;
+         break;
+      }
+
+      if (h.type == DIST_VIEW && h.len == sizeof(dv))
+      {
+         if (dist_read(rfd, &dv, sizeof(dv)))
+            break;
+
+         perturb_free(&v);
+         memset(&v, 0, sizeof(v));
+         v.hres = dv.hres;
+         v.vres = dv.vres;
+         v.mode = dv.mode < NUM_MODE ? dv.mode : MODE_FULL;
+         maxiterate_ = dv.maxiterate;
+         interior_ = dv.interior;
+         formula_ = dv.formula;
+         julia_ = dv.julia;
+         julia_real_ = dv.julia_real;
+         julia_imag_ = dv.julia_imag;
+         formula_select();
+         for (int i = 0; i < 4; i++)
+         {
+            dv.bbox[i][sizeof(dv.bbox[i]) - 1] = '\0';
+            sbbox[i] = dv.bbox[i];
+         }
+         if (v.hres < 1 || v.vres < 1 || view_setup(&v, sbbox, dv.cc, dv.limbs, dv.direct) == -1)
+         {
+            ret = -1;
+            break;
+         }
+         setup = 1;
+      }
+      else if (h.type == DIST_BAND && h.len == sizeof(b) && setup)
+      {
+         if (dist_read(rfd, &b, sizeof(b)))
+            break;
+         if (b.r0 >= b.r1 || b.r1 > (unsigned) v.vres)
+         {
+            fprintf(stderr, "worker: illegal band %u-%u\n", b.r0, b.r1);
+            ret = -1;
+            break;
+         }
+         if ((p = realloc(buf, v.hres * (b.r1 - b.r0) * sizeof(*buf))) == NULL)
+         {
+            perror("realloc()");
+            ret = -1;
+            break;
+         }
+         buf = p;
+
+         // the image is stored bottom up, thus PNG row r0 is the first row of the buffer
+         v.image = buf - v.hres * b.r0;
+         // on error the connection is closed, the coordinator gives the band to another worker
+         if (sched_render(&v, v.vres - b.r1, v.vres - b.r0, nthreads) == -1)
+         {
+            fprintf(stderr, "worker: band %u-%u failed\n", b.r0, b.r1);
+            ret = -1;
+            break;
+         }
+         if (dist_send(wfd, DIST_RESULT, h.id, &b, sizeof(b), buf, v.hres * (b.r1 - b.r0) * sizeof(*buf)))
+         {
+            ret = -1;
+            break;
+         }
+      }
+      else
+      {
+         fprintf(stderr, "worker: unexpected frame type %u\n", h.type);
+         ret = -1;
+         break;
+      }
+   }
+
+   perturb_free(&v);
+   free(buf);
+   return ret;
+}
+
+
+/*! Run a worker.
+ * @param addr Address to listen on (see srv_socket()), or "-" to serve the
+ * coordinator on stdin/stdout.
+ * @param nthreads Number of threads.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int dist_worker(const char *addr, int nthreads)
+{
+   int fd, lfd;
+
+   if (!strcmp(addr, "-"))
+      return dist_serve(0, 1, nthreads);
+
+   if ((lfd = srv_socket(addr, 1)) == -1)
+      return -1;
+
+   signal(SIGPIPE, SIG_IGN);
+   // serve one coordinator after the other
+   for (;;)
+   {
+      if ((fd = accept(lfd, NULL, NULL)) == -1)
+      {
+         perror("accept()");
+         continue;
+      }
+      dist_serve(fd, fd, nthreads);
+      close(fd);
+   }
+
+   return 0;
+}
+
+
+/*! Start a local worker process connected through pipes.
+ * @param c Pointer to the connection.
+ * @param cmd Shell command which runs the worker, or NULL to start this
+ * program.
+ * @param nthreads Number of threads of a local worker.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int dist_spawn(dist_conn_t *c, const char *cmd, int nthreads)
+{
+   int in[2], out[2];
+   char n[16], k[128];
+
+   if (pipe(in) == -1)
+   {
+      perror("pipe()");
+      return -1;
+   }
+   if (pipe(out) == -1)
+   {
+      perror("pipe()");
+      close(in[0]);
+      close(in[1]);
+      return -1;
+   }
+   // other workers must not inherit the pipes, otherwise they never see the end of file
+   fcntl(in[1], F_SETFD, FD_CLOEXEC);
+   fcntl(out[0], F_SETFD, FD_CLOEXEC);
+
+   switch (c->pid = fork())
+   {
+      case -1:
+         perror("fork()");
+         close(in[0]);
+         close(in[1]);
+         close(out[0]);
+         close(out[1]);
+         return -1;
+
+      case 0:
+         dup2(in[0], 0);
+         dup2(out[1], 1);
+         close(in[0]);
+         close(out[1]);
+         if (cmd != NULL)
+            execl("/bin/sh", "sh", "-c", cmd, (char*) NULL);
+         else
+         {
+            // the worker uses the same kernels without calibration
+            snprintf(n, sizeof(n), "%d", nthreads);
+            kernel_names(k, sizeof(k));
+            execl("/proc/self/exe", "intfract", "-W", "-", "-n", n, "-k", k, (char*) NULL);
+         }
+         perror("execl()");
+         _exit(127);
+   }
+
+   close(in[0]);
+   close(out[1]);
+   c->wfd = in[1];
+   c->rfd = out[0];
+   return 0;
+}
+
+
+/*! Close the connection to a worker.
+ */
+static void dist_drop(dist_conn_t *c)
+{
+   close(c->rfd);
+   if (c->wfd != c->rfd)
+      close(c->wfd);
+   c->band = -2;
+}
+
+
+/*! Start or connect the workers.
+ * @param c Array of connections.
+ * @param workers Comma separated list of workers: a number n starts n local
+ * workers, "!cmd" starts a worker with the shell command cmd, anything else
+ * is the address of a listening worker.
+ * @param nthreads Total number of threads for the local workers.
+ * @return Returns the number of workers.
+ */
+static int dist_connect(dist_conn_t *c, const char *workers, int nthreads)
+{
+   char *s, *item, *save;
+   int n = 0, k, local = 0;
+
+   if ((s = strdup(workers)) == NULL)
+   {
+      perror("strdup()");
+      return 0;
+   }
+
+   // count the local workers to distribute the threads
+   for (item = strtok_r(s, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+      if (isdigit((unsigned char) *item))
+         local += atoi(item);
+   strcpy(s, workers);
+
+   for (item = strtok_r(s, ",", &save); item != NULL && n < DIST_MAX_WORKERS; item = strtok_r(NULL, ",", &save))
+   {
+      memset(&c[n], 0, sizeof(c[n]));
+      if (isdigit((unsigned char) *item))
+      {
+         for (k = atoi(item); k > 0 && n < DIST_MAX_WORKERS; k--)
+            if (!dist_spawn(&c[n], NULL, nthreads / local > 0 ? nthreads / local : 1))
+               n++;
+      }
+      else if (*item == '!')
+      {
+         if (!dist_spawn(&c[n], item + 1, nthreads))
+            n++;
+      }
+      else if ((c[n].rfd = c[n].wfd = srv_socket(item, 0)) != -1)
+         n++;
+   }
+
+   free(s);
+   return n;
+}
+
+
+/*! Render an image with workers and write it to a PNG file.
+ * @param v Pointer to the view. It must be set up with view_setup(), the
+ * reference orbit is not needed.
+ * @param sbbox Coordinates as given on the command line.
+ * @param cc 1 if sbbox contains center and width/height.
+ * @param direct 1 to iterate every pixel in multi-precision.
+ * @param workers List of workers, see dist_connect().
+ * @param band Height of a band in rows.
+ * @param nthreads Number of threads for local workers.
+ * @param out Name of the output file, "-" for stdout.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int dist_render(fract_view_t *v, const char * const *sbbox, int cc, int direct, const char *workers, int band, int nthreads, const char *out)
+{
+   dist_conn_t conn[DIST_MAX_WORKERS];
+   struct pollfd pfd[DIST_MAX_WORKERS];
+   int pidx[DIST_MAX_WORKERS];
+   dist_view_t dv;
+   dist_band_t b;
+   dist_hdr_t h;
+   stream_t *st;
+   int **res, *prev = NULL, *nrun, nconn, nb, next = 0, alive, i, k, n, ret = -1;
+   double t, avg = 0;
+   long ndone = 0;
+
+   if (band < 1)
+      band = TILE_SIZE;
+   if (band > v->vres)
+      band = v->vres;
+   nb = (v->vres + band - 1) / band;
+
+   signal(SIGPIPE, SIG_IGN);
+   if (!(nconn = dist_connect(conn, workers, nthreads)))
+   {
+      fprintf(stderr, "no workers\n");
+      return -1;
+   }
+
+   memset(&dv, 0, sizeof(dv));
+   dv.hres = v->hres;
+   dv.vres = v->vres;
+   dv.maxiterate = maxiterate_;
+   dv.interior = interior_;
+   // the precision was chosen already, 1 is native, the 32 bit kernels are chosen again by the same rule
+   dv.limbs = v->narrow ? LIMBS_NARROW : v->limbs ? v->limbs : 1;
+   dv.mode = v->mode;
+   dv.direct = direct;
+   dv.cc = cc;
+   dv.formula = formula_;
+   dv.julia = julia_;
+   dv.julia_real = julia_real_;
+   dv.julia_imag = julia_imag_;
+   for (i = 0; i < 4; i++)
+      snprintf(dv.bbox[i], sizeof(dv.bbox[i]), "%s", sbbox[i]);
+
+   for (i = 0; i < nconn; i++)
+   {
+      conn[i].band = -1;
+      if (dist_send(conn[i].wfd, DIST_VIEW, 0, &dv, sizeof(dv), NULL, 0))
+      {
+         fprintf(stderr, "worker %d failed\n", i);
+         dist_drop(&conn[i]);
+      }
+   }
+
+   if ((res = calloc(nb, sizeof(*res) + sizeof(*nrun))) == NULL)
+   {
+      perror("calloc()");
+      goto dist_exit;
+   }
+   nrun = (int*) (res + nb);
+
+   if ((st = stream_open(out, v->hres, v->vres)) == NULL)
+      goto dist_free;
+
+   while (next < nb)
+   {
+      t = dist_time();
+      for (i = 0, alive = 0; i < nconn; i++)
+      {
+         if (conn[i].band == -2)
+            continue;
+         alive++;
+         if (conn[i].band != -1)
+            continue;
+
+         // the first open band, otherwise a slow one
+         for (k = next; k < nb && (res[k] != NULL || nrun[k]); k++);
+         if (k >= nb)
+            for (k = next; k < nb; k++)
+               if (res[k] == NULL && nrun[k] == 1)
+               {
+                  for (n = 0; n < nconn && conn[n].band != k; n++);
+                  if (t - conn[n].t0 > (DIST_SLOW * avg > DIST_TIMEOUT ? DIST_SLOW * avg : DIST_TIMEOUT))
+                     break;
+               }
+         if (k >= nb)
+            continue;
+
+         b.r0 = k * band;
+         b.r1 = b.r0 + band < (unsigned) v->vres ? b.r0 + band : (unsigned) v->vres;
+         if (dist_send(conn[i].wfd, DIST_BAND, k, &b, sizeof(b), NULL, 0))
+         {
+            fprintf(stderr, "worker %d failed\n", i);
+            dist_drop(&conn[i]);
+            alive--;
+            continue;
+         }
+         conn[i].band = k;
+         conn[i].t0 = t;
+         nrun[k]++;
+      }
+
+      if (!alive)
+      {
+         fprintf(stderr, "all workers failed\n");
+         break;
+      }
+
+      for (i = 0, n = 0; i < nconn; i++)
+         if (conn[i].band >= 0)
+         {
+            pfd[n].fd = conn[i].rfd;
+            pfd[n].events = POLLIN;
+            pidx[n++] = i;
+         }
+
+      if (poll(pfd, n, 100) == -1)
+      {
+         perror("poll()");
+         break;
+      }
+
+      for (int j = 0; j < n; j++)
+      {
+         dist_conn_t *c = &conn[pidx[j]];
+         int *buf = NULL;
+
+         if (!pfd[j].revents)
+            continue;
+
+         k = c->band;
+         b.r0 = k * band;
+         b.r1 = b.r0 + band < (unsigned) v->vres ? b.r0 + band : (unsigned) v->vres;
+         size_t len = v->hres * (b.r1 - b.r0) * sizeof(*buf);
+         dist_band_t rb;
+
+         if (dist_read(c->rfd, &h, sizeof(h)) || h.magic != DIST_MAGIC || h.type != DIST_RESULT ||
+               h.id != (unsigned) k || h.len != sizeof(rb) + len ||
+               dist_read(c->rfd, &rb, sizeof(rb)) || rb.r0 != b.r0 || rb.r1 != b.r1 ||
+               (buf = malloc(len)) == NULL || dist_read(c->rfd, buf, len))
+         {
+            // the band is calculated again by another worker
+            fprintf(stderr, "worker %d failed\n", pidx[j]);
+            free(buf);
+            nrun[k]--;
+            dist_drop(c);
+            continue;
+         }
+
+         nrun[k]--;
+         c->band = -1;
+         if (res[k] != NULL || k < next)
+         {
+            free(buf);
+            continue;
+         }
+         res[k] = buf;
+         avg = (avg * ndone + dist_time() - c->t0) / (ndone + 1);
+         ndone++;
+
+         // merge into the iteration map
+         if (v->map != NULL)
+         {
+            v->image = buf - v->hres * b.r0;
+            itmap_put(v->map, v, 0, v->vres - b.r1, v->hres, v->vres - b.r0);
+            v->image = NULL;
+         }
+      }
+
+      // write the bands in order, the previous one is freed after the writer took the next one
+      for (; next < nb && res[next] != NULL; next++)
+      {
+         if (stream_put(st, res[next], (next + 1) * band < v->vres ? band : v->vres - next * band))
+            goto dist_close;
+         free(prev);
+         prev = res[next];
+         res[next] = NULL;
+      }
+   }
+   if (next >= nb)
+      ret = 0;
+
+dist_close:
+   if (stream_close(st))
+      ret = -1;
+   free(prev);
+dist_free:
+   for (i = 0; i < nb; i++)
+      free(res[i]);
+   free(res);
+dist_exit:
+   // the workers terminate at the end of file
+   for (i = 0; i < nconn; i++)
+   {
+      if (conn[i].band != -2)
+         dist_drop(&conn[i]);
+      if (conn[i].pid > 0)
+      {
+         kill(conn[i].pid, SIGTERM);
+         waitpid(conn[i].pid, NULL, 0);
+      }
+   }
+
+   return ret;
+}
@@ -0,0 +1,276 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file formula.c
+ * This file contains the kernels of other formulas than the Mandelbrot set
+ * z^2 + c: the Multibrot sets z^3 + c and z^4 + c, the Burning Ship and the
+ * Julia sets of all of them. Each formula is an instance of the same loop
+ * formula_loop() with the formula as constant parameter, thus every kernel is
+ * straight-line code without branches on the formula. The exponent is
+ * expanded into multiplications and the Julia constant is loaded into a
+ * register once per pixel.
+ *
+ * The Mandelbrot set itself is calculated by the kernels of the kernel table
+ * (see kernel.c). The formula kernels are scalar kernels in the number format
+ * of the build (nint_t), the batch kernel "scalar" calls them.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "intfract.h"
+
+
+//! formulas
+enum {F_MANDEL, F_MULTI3, F_MULTI4, F_SHIP, NUM_FORMULA};
+
+__thread int formula_ = F_MANDEL;
+__thread int julia_ = 0;
+//! constant c of the Julia set
+__thread nint_t julia_real_, julia_imag_;
+
+
+#ifdef USE_DOUBLE
+#define F_MUL(a, b) ((a) * (b))
+#define F_MUL2(a, b) ((a) * (b) * 2)
+#define F_ABS(a) fabs(a)
+#elif defined(WITH_IMUL128)
+#define F_MUL(a, b) ((nint_t) (((__int128_t) (a) * (b)) >> NORM_BITS))
+#define F_MUL2(a, b) ((nint_t) (((__int128_t) (a) * (b)) >> (NORM_BITS - 1)))
+#define F_ABS(a) labs(a)
+#else
+#define F_MUL(a, b) (((a) * (b)) >> NORM_BITS)
+#define F_MUL2(a, b) (((a) * (b)) >> (NORM_BITS - 1))
+#define F_ABS(a) labs(a)
+#endif
+
+
+/*! Calculate the next point of the orbit.
+ * @param real Real part of z.
+ * @param imag Imaginary part of z.
+ * @param realq Square of the real part.
+ * @param imagq Square of the imaginary part.
+ * @param f Formula, this is a constant thus the switch is resolved at compile
+ * time.
+ */
+static inline __attribute__((always_inline)) void formula_step(nint_t *real, nint_t *imag, nint_t realq, nint_t imagq, nint_t cr, nint_t ci, int f)
+{
+   nint_t a, b;
+
+   switch (f)
+   {
+      // z^3 = x (x^2 - 3 y^2) + i y (3 x^2 - y^2)
+      case F_MULTI3:
+         a = F_MUL(*real, realq - 3 * imagq) + cr;
+         *imag = F_MUL(*imag, 3 * realq - imagq) + ci;
+         *real = a;
+         break;
+
+      // z^4 = (z^2)^2
+      case F_MULTI4:
+         a = realq - imagq;
+         b = F_MUL2(*real, *imag);
+         *imag = F_MUL2(a, b) + ci;
+         *real = F_MUL(a, a) - F_MUL(b, b) + cr;
+         break;
+
+      // (|x| + i |y|)^2
+      case F_SHIP:
+         *imag = F_ABS(F_MUL2(*real, *imag)) + ci;
+         *real = realq - imagq + cr;
+         break;
+
+      default:
+         *imag = F_MUL2(*real, *imag) + ci;
+         *real = realq - imagq + cr;
+   }
+}
+
+
+/*! This function contains the iteration loop of all formulas. It is
+ * instantiated once for each formula below.
+ * @param real Real part of the start value z0.
+ * @param imag Imaginary part of z0.
+ * @param cr Real part of the constant c.
+ * @param ci Imaginary part of c.
+ * @param f Formula.
+ * @return Returns the number of iterations to reach the break condition.
+ */
+static inline __attribute__((always_inline)) int formula_loop(nint_t real, nint_t imag, nint_t cr, nint_t ci, int f)
+{
+   nint_t realq, imagq;
+   int i;
+
+#ifdef WITH_INTERIOR
+   // Brent's cycle detection, see iterate_periodic()
+   if (interior_)
+   {
+      nint_t realc = real, imagc = imag;
+      int k, period;
+
+      for (i = 0, k = period = 1; i < maxiterate_; i++)
+      {
+         realq = F_MUL(real, real);
+         imagq = F_MUL(imag, imag);
+
+         if ((realq + imagq) > (nint_t) 4 * NORM_FACT)
+            break;
+
+         formula_step(&real, &imag, realq, imagq, cr, ci, f);
+
+         if (real == realc && imag == imagc)
+            return maxiterate_;
+
+         if (!--k)
+         {
+            k = period <<= 1;
+            realc = real;
+            imagc = imag;
+         }
+      }
+      return i;
+   }
+#endif
+
+   for (i = 0; i < maxiterate_; i++)
+   {
+      realq = F_MUL(real, real);
+      imagq = F_MUL(imag, imag);
+
+      if ((realq + imagq) > (nint_t) 4 * NORM_FACT)
+         break;
+
+      formula_step(&real, &imag, realq, imagq, cr, ci, f);
+   }
+   return i;
+}
+
+
+//! kernel of a formula, c is the pixel
+#define FORMULA_KERNEL(name, f) \
+   static int iterate_##name(nint_t real0, nint_t imag0) \
+   { return formula_loop(real0, imag0, real0, imag0, f); }
+
+//! kernel of the Julia set of a formula, z0 is the pixel
+#define FORMULA_JULIA(name, f) \
+   static int iterate_##name##_julia(nint_t real0, nint_t imag0) \
+   { return formula_loop(real0, imag0, julia_real_, julia_imag_, f); }
+
+FORMULA_JULIA(mandel, F_MANDEL)
+FORMULA_KERNEL(multi3, F_MULTI3)
+FORMULA_JULIA(multi3, F_MULTI3)
+FORMULA_KERNEL(multi4, F_MULTI4)
+FORMULA_JULIA(multi4, F_MULTI4)
+FORMULA_KERNEL(ship, F_SHIP)
+FORMULA_JULIA(ship, F_SHIP)
+
+
+typedef struct formula
+{
+   const char *name;
+   //! kernel or NULL to use the kernel table
+   int (*iterate)(nint_t, nint_t);
+   //! kernel of the Julia set
+   int (*julia)(nint_t, nint_t);
+} formula_t;
+
+static const formula_t formula_tab_[NUM_FORMULA] =
+{
+   {"mandel", NULL, iterate_mandel_julia},
+   {"multibrot3", iterate_multi3, iterate_multi3_julia},
+   {"multibrot4", iterate_multi4, iterate_multi4_julia},
+   {"ship", iterate_ship, iterate_ship_julia},
+};
+
+/*! Activate the kernel of the formula formula_ and julia_. This function must
+ * be called after kernel_init().
+ */
+void formula_select(void)
+{
+   static int (*kernel)(nint_t, nint_t) = NULL;
+#ifdef WITH_SIMD
+   static void (*kernel_vec)(const nint_t *, const nint_t *, int *, int);
+#endif
+   const formula_t *f = &formula_tab_[formula_ >= 0 && formula_ < NUM_FORMULA ? formula_ : F_MANDEL];
+
+   // save the kernels of the kernel table
+   if (kernel == NULL)
+   {
+      kernel = iterate;
+#ifdef WITH_SIMD
+      kernel_vec = iterate_vec;
+#endif
+   }
+
+   if (julia_)
+      iterate = f->julia;
+   else
+      iterate = f->iterate != NULL ? f->iterate : kernel;
+#ifdef WITH_SIMD
+   // the batch kernels calculate the Mandelbrot set only
+   iterate_vec = iterate == kernel ? kernel_vec : iterate_vec_scalar;
+#endif
+}
+
+
+/*! Select the formula.
+ * @param name Name of the formula or NULL for the Mandelbrot set.
+ * @param julia Constant c as "real,imag" to calculate the Julia set, or NULL.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int formula_init(const char *name, const char *julia)
+{
+   double c[2];
+
+   if (name != NULL)
+   {
+      for (formula_ = 0; formula_ < NUM_FORMULA && strcmp(name, formula_tab_[formula_].name); formula_++);
+      if (formula_ >= NUM_FORMULA)
+      {
+         fprintf(stderr, "unknown formula %s\n", name);
+         formula_ = F_MANDEL;
+         return -1;
+      }
+   }
+
+   if (julia != NULL)
+   {
+      if (sscanf(julia, "%lf,%lf", &c[0], &c[1]) != 2)
+      {
+         fprintf(stderr, "illegal Julia constant %s\n", julia);
+         return -1;
+      }
+      julia_ = 1;
+      julia_real_ = c[0] * NORM_FACT;
+      julia_imag_ = c[1] * NORM_FACT;
+   }
+
+   formula_select();
+   return 0;
+}
+
+
+/*! Print the names of the formulas.
+ */
+void formula_list(FILE *f)
+{
+   for (int i = 0; i < NUM_FORMULA; i++)
+      fprintf(f, " %s", formula_tab_[i].name);
+}
@@ -30,31 +30,134 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <math.h>
 #include <cairo.h>
-#ifdef WITH_TIME
-#include <sys/time.h>
+#include "intfract.h"
+
+__thread int maxiterate_ = MAXITERATE;
+//! use interior checks in iterate(), see WITH_INTERIOR
+__thread int interior_ = 1;
+__thread int colset_ = 0;
+//! color of each iteration count 0 to maxiterate_, see palette_init()
+__thread uint32_t *palette_;
+
+
+/*! Save the render parameters of the current thread.
+ * @param p Pointer to the structure which receives the parameters.
+ */
+void param_get(fract_param_t *p)
+{
+   p->maxiterate = maxiterate_;
+   p->interior = interior_;
+   p->colset = colset_;
+   p->formula = formula_;
+   p->julia = julia_;
+   p->julia_real = julia_real_;
+   p->julia_imag = julia_imag_;
+   p->palette = palette_;
+   p->iterate = iterate;
+#ifdef WITH_SIMD
+   p->iterate_vec = iterate_vec;
 #endif
-#ifdef WITH_THREADS
-#include <stdint.h>
-#include <pthread.h>
+}
+
+
+/*! Set the render parameters of the current thread.
+ * @param p Pointer to the parameters, see param_get().
+ */
+void param_set(const fract_param_t *p)
+{
+   maxiterate_ = p->maxiterate;
+   interior_ = p->interior;
+   colset_ = p->colset;
+   formula_ = p->formula;
+   julia_ = p->julia;
+   julia_real_ = p->julia_real;
+   julia_imag_ = p->julia_imag;
+   palette_ = p->palette;
+   iterate = p->iterate;
+#ifdef WITH_SIMD
+   iterate_vec = p->iterate_vec;
 #endif
+}
 
-#include "intfract.h"
 
-#define WIDTH 1920
-#define HEIGHT 1080
+/* The following macros calculate the coordinates of column x and row y within
+ * the complex plane. They expect the local variables of mand_calc() and
+ * mand_pixel(), thus all functions calculate exactly the same coordinates.
+ */
+#ifdef USE_DOUBLE
+#define MAND_REAL(x) (realmin + deltareal * (x))
+#define MAND_IMAG(y) (imagmax - deltaimag * (y))
+#else
+#define MAND_REAL(x) (realmin + deltareal * (x) / hres)
+// all rows of a run (which are below int resolution) get the same value
+#define MAND_IMAG(y) (imagmax - deltaimag * ((y) - (y) % run) / vres)
+#endif
+//! first row of the next run
+#define MAND_NEXT(y) ((y) - (y) % run + run)
 
-enum {COLSET_RED, COLSET_GREEN_BLUE, COLSET_RED_YELLOW, COLSET_BLUE, COLSET_BLACK_WHITE, NUM_COLSET};
 
+/*! Calculate the real coordinates of a range of columns. The result is
+ * identical to MAND_REAL() but the integer variant avoids the multiplication
+ * and division per column: the quotient deltareal * x / hres is stepped
+ * exactly by keeping its quotient and remainder.
+ * @param reals Array which receives the coordinates.
+ * @param x0 First column.
+ * @param w Number of columns.
+ */
+static void mand_reals(nint_t *reals, nint_t realmin, nint_t deltareal, int hres, int x0, int w)
+{
+#ifdef USE_DOUBLE
+  for (int x = 0; x < w; x++)
+    reals[x] = MAND_REAL(x0 + x);
+#else
+  // the remainder has the sign of the product because C truncates towards 0
+  nint_t q = deltareal / hres, r = deltareal % hres, quot, rem;
+  __int128_t p = (__int128_t) deltareal * x0;
 
-int maxiterate_ = MAXITERATE;
-static int colset_ = 0;
+  quot = p / hres;
+  rem = p % hres;
+  for (int x = 0; x < w; x++)
+  {
+    reals[x] = realmin + quot;
+    quot += q;
+    rem += r;
+    if (rem >= hres)
+    {
+      rem -= hres;
+      quot++;
+    }
+    else if (rem <= -hres)
+    {
+      rem += hres;
+      quot--;
+    }
+  }
+#endif
+}
+
+
+/*! Copy a row of a section to the following rows. This is used for rows
+ * which are below int resolution and thus have the same coordinates.
+ * @param row Pointer to the first pixel of the section in the source row.
+ * @param hres Pixel width of image.
+ * @param w Width of the section.
+ * @param n Number of rows to fill, they follow the source row, i.e. they are
+ * below it in memory.
+ */
+static void mand_dup(int *row, int hres, int w, int n)
+{
+  for (int i = 1; i <= n; i++)
+    memcpy(row - hres * i, row, w * sizeof(*row));
+}
 
 
 /*! This function contains the outer loop, i.e. calculate the coordinates
- * within the complex plane for each pixel and then call iterate().
+ * within the complex plane for each pixel of a rectangular section of the
+ * image and then call iterate(). The section is calculated row by row. In the
+ * integer variant consecutive rows may be below int resolution, then only the
+ * first row of such a run is calculated and the others are duplicated.
  * @param image Pointer to image array of size hres * vres elements.
  * @param realmin Minimun real value of image.
  * @param imagmin Minimum imaginary value of image.
@@ -62,90 +165,395 @@ static int colset_ = 0;
  * @param imagmax Maximum imaginary value.
  * @param hres Pixel width of image.
  * @param vres Pixel height of image.
- * @param start Column to start calculation with.
- * @param skip Number of columns to skip before starting with the next column.
+ * @param x0 First column of the section.
+ * @param y0 First row of the section, row 0 is at imagmax.
+ * @param x1 Column following the last column of the section.
+ * @param y1 Row following the last row of the section.
+ * @return Returns 0 on success, or -1 on error.
  */
-void mand_calc(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int start, int skip)
+int mand_calc(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1)
 {
-  nint_t deltareal, deltaimag, real0,  imag0;
-  int x, y;
+  nint_t deltareal, deltaimag, imag0, *reals;
+  int y, yn, w = x1 - x0, h, *row;
 
   deltareal = realmax - realmin;
   deltaimag = imagmax - imagmin;
 
 #ifdef USE_DOUBLE
-  // With datatype double we can minimize operations by incrementing real0 and
-  // image0 by a fraction of the pixelresolution.
+  // With datatype double we can minimize operations by multiplying with a
+  // fraction of the pixelresolution.
   deltareal /= hres;
   deltaimag /= vres;
+  int run = 1;
+#else
+  // Fractional inrementation does not work well with integers because of the
+  // resolution of the delta being too low. Thus, the real coordinates are
+  // stepped by quotient and remainder (see mand_reals()).
+  // Rows which are below int resolution get the same imaginary value, thus
+  // only the first row of such a run is calculated and then copied.
+  int run = deltaimag > 0 ? (vres - 1) / deltaimag + 1 : vres;
+#endif
+
+  // number of rows which are calculated
+  for (h = 0, y = y0; y < y1; y = MAND_NEXT(y))
+    h++;
+
+#ifdef WITH_SIMD
+  // The batch kernel is fed with all pixels of the section at once.
+  nint_t *imags;
+  int *cnt, n, x;
 
-  real0 = realmin + deltareal * start;
-  for (x = start; x < hres; x += skip)
+  if ((reals = malloc(w * h * (2 * sizeof(*reals) + sizeof(*cnt)))) == NULL)
   {
-    imag0 = imagmax;
-    for (y = 0; y < vres; y++)
-    {
-      *(image + x + hres * (vres - y - 1)) = iterate(real0, imag0);
-      imag0 -= deltaimag;
-    }
-    real0 += deltareal * skip;
+    perror("malloc()");
+    return -1;
+  }
+  imags = reals + w * h;
+  cnt = (int*) (imags + w * h);
+
+  mand_reals(reals, realmin, deltareal, hres, x0, w);
+  for (n = 0, y = y0; y < y1; y = MAND_NEXT(y), n += w)
+  {
+    if (n)
+      memcpy(reals + n, reals, w * sizeof(*reals));
+    imag0 = MAND_IMAG(y);
+    for (x = 0; x < w; x++)
+      imags[n + x] = imag0;
+  }
+
+  if (n > 0)
+  {
+    iterate_vec(reals, imags, cnt, n);
+    STAT_COUNT(cnt, n);
+  }
+
+  for (n = 0, y = y0; y < y1; y = yn, n += w)
+  {
+    yn = MAND_NEXT(y) < y1 ? MAND_NEXT(y) : y1;
+    row = image + x0 + hres * (vres - y - 1);
+    memcpy(row, cnt + n, w * sizeof(*row));
+    mand_dup(row, hres, w, yn - y - 1);
   }
 #else
-  // Fractional inrementation does not work well with integers because of the
-  // resolution of the delta being too low. Thus, the outer loop has slightly
-  // more operations in the integer variant than in the double variant.
-  int col;
-  for (x = start; x < hres; x += skip)
+  if ((reals = malloc(w * sizeof(*reals))) == NULL)
   {
-    real0 = realmin + deltareal * x / hres;
-    for (y = 0; y < vres;)
+    perror("malloc()");
+    return -1;
+  }
+
+  mand_reals(reals, realmin, deltareal, hres, x0, w);
+  for (y = y0; y < y1; y = yn)
+  {
+    yn = MAND_NEXT(y) < y1 ? MAND_NEXT(y) : y1;
+    row = image + x0 + hres * (vres - y - 1);
+    imag0 = MAND_IMAG(y);
+    for (int x = 0; x < w; x++)
+      row[x] = iterate(reals[x], imag0);
+    STAT_COUNT(row, w);
+    mand_dup(row, hres, w, yn - y - 1);
+  }
+#endif
+
+  free(reals);
+  return 0;
+}
+
+
+/*! Calculate a single pixel. The coordinates are determined in exactly the
+ * same way as in mand_calc().
+ * @param x Column of the pixel.
+ * @param y Row of the pixel.
+ * @return Returns the number of iterations.
+ */
+int mand_pixel(nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x, int y)
+{
+  nint_t deltareal, deltaimag;
+
+  deltareal = realmax - realmin;
+  deltaimag = imagmax - imagmin;
+
+#ifdef USE_DOUBLE
+  deltareal /= hres;
+  deltaimag /= vres;
+#else
+  int run = deltaimag > 0 ? (vres - 1) / deltaimag + 1 : vres;
+#endif
+
+  return iterate(MAND_REAL(x), MAND_IMAG(y));
+}
+
+
+//! number of pixels per batch of mand_row()
+#define ROW_BATCH 64
+
+/*! Calculate every step-th pixel of a row. The coordinates are exactly the
+ * same as in mand_calc(), mand_mp() and mand_pt().
+ * @param v Pointer to the view.
+ * @param cnt Array which receives the iteration counts of the n pixels.
+ * @param y Row, row 0 is at imagmax.
+ * @param x0 First column.
+ * @param step Distance of the columns.
+ * @param n Number of pixels.
+ */
+void mand_row(const fract_view_t *v, int *cnt, int y, int x0, int step, int n)
+{
+  nint_t realmin = v->realmin, imagmax = v->imagmax, deltareal, deltaimag;
+  nint_t reals[ROW_BATCH], imags[ROW_BATCH];
+  int hres = v->hres, vres = v->vres, i, m;
+
+  if (v->zref != NULL || v->limbs)
+  {
+    for (i = 0; i < n; i++)
+      cnt[i] = v->zref != NULL ? mand_pt_pixel(v, x0 + i * step, y) : mand_mp_pixel(v, x0 + i * step, y);
+    return;
+  }
+
+  deltareal = v->realmax - realmin;
+  deltaimag = imagmax - v->imagmin;
+#ifdef USE_DOUBLE
+  deltareal /= hres;
+  deltaimag /= vres;
+#else
+  int run = deltaimag > 0 ? (vres - 1) / deltaimag + 1 : vres;
+#endif
+
+  for (; n > 0; n -= m, cnt += m, x0 += m * step)
+  {
+    m = n < ROW_BATCH ? n : ROW_BATCH;
+    for (i = 0; i < m; i++)
     {
-      imag0 = imagmax - deltaimag * y / vres;
-      col = iterate(real0, imag0);
-      // fill all pixels which are below int resolution with the same iteration value
-      for (int _y = 0; y < vres && deltaimag * _y < vres; _y++, y++)
-         *(image + x + hres * (vres - y - 1)) = col;
+#ifdef USE_DOUBLE
+      reals[i] = MAND_REAL(x0 + i * step);
+#else
+      // same quotient as in mand_reals()
+      reals[i] = realmin + (nint_t) ((__int128_t) deltareal * (x0 + i * step) / hres);
+#endif
+      imags[i] = MAND_IMAG(y);
     }
-  }
+#ifdef WITH_SIMD
+    iterate_vec(reals, imags, cnt, m);
+#else
+    for (i = 0; i < m; i++)
+      cnt[i] = iterate(reals[i], imags[i]);
 #endif
+  }
 }
 
 
-static int nthreads_ = NUM_THREADS;
-#ifdef WITH_THREADS
-static int *image_;
-static nint_t realmin_, imagmin_, realmax_, imagmax_;
-static int hres_, vres_;
+//! parameters of the rectangle subdivision of mand_ms()
+typedef struct ms_ctx
+{
+  int *image;
+  nint_t realmin, imagmax, deltareal, deltaimag;
+  int hres, vres, run;
+  //! buffers for the border pixels
+  nint_t *reals, *imags;
+  int *cnt, *pix;
+} ms_ctx_t;
+
+#define MS_PIX(c, x, y) (c)->image[(x) + (c)->hres * ((c)->vres - (y) - 1)]
+
+//! add pixel to the border buffers if it was not calculated yet
+#define MS_ADD(c, n, x, y) if (MS_PIX(c, x, y) == -1) { \
+  (c)->reals[n] = MAND_REAL(x); \
+  (c)->imags[n] = MAND_IMAG(y); \
+  (c)->pix[n++] = (x) + hres * (vres - (y) - 1); }
+
+
+/*! Calculate all pixels on the border of a rectangle which were not
+ * calculated yet (which are set to -1).
+ * @param c Pointer to context.
+ * @param x0 Left column.
+ * @param y0 Top row.
+ * @param x1 Right column (inclusive).
+ * @param y1 Bottom row (inclusive).
+ */
+static void ms_border(ms_ctx_t *c, int x0, int y0, int x1, int y1)
+{
+  nint_t realmin = c->realmin, imagmax = c->imagmax, deltareal = c->deltareal, deltaimag = c->deltaimag;
+  int hres = c->hres, vres = c->vres, x, y, n, i;
+#ifndef USE_DOUBLE
+  int run = c->run;
+#endif
+
+  // collect the pixels of the top and bottom row, and of the left and right column
+  for (n = 0, y = y0; y <= y1; y += y1 > y0 ? y1 - y0 : 1)
+    for (x = x0; x <= x1; x++)
+      MS_ADD(c, n, x, y);
+  for (y = y0 + 1; y < y1; y++)
+    for (x = x0; x <= x1; x += x1 > x0 ? x1 - x0 : 1)
+      MS_ADD(c, n, x, y);
+
+#ifdef WITH_SIMD
+  if (n > 0)
+    iterate_vec(c->reals, c->imags, c->cnt, n);
+#else
+  for (i = 0; i < n; i++)
+    c->cnt[i] = iterate(c->reals[i], c->imags[i]);
+#endif
+
+  for (i = 0; i < n; i++)
+    c->image[c->pix[i]] = c->cnt[i];
+}
 
 
-void *mand_thread(void *n)
+/*! Recursive rectangle subdivision. If all pixels on the border of the
+ * rectangle have the same iteration count, the interior is filled with it.
+ * Otherwise the rectangle is split into two halves along its longer side.
+ */
+static void ms_rect(ms_ctx_t *c, int x0, int y0, int x1, int y1)
 {
-   mand_calc(image_, realmin_, imagmin_, realmax_, imagmax_, hres_, vres_, (intptr_t) n, nthreads_);
-   return NULL;
+  int x, y, col;
+
+  ms_border(c, x0, y0, x1, y1);
+
+  // no interior pixels
+  if (x1 - x0 < 2 || y1 - y0 < 2)
+    return;
+
+  col = MS_PIX(c, x0, y0);
+  for (x = x0; x <= x1; x++)
+    if (MS_PIX(c, x, y0) != col || MS_PIX(c, x, y1) != col)
+      break;
+  if (x > x1)
+  {
+    for (y = y0 + 1; y < y1; y++)
+      if (MS_PIX(c, x0, y) != col || MS_PIX(c, x1, y) != col)
+        break;
+    if (y >= y1)
+    {
+      for (y = y0 + 1; y < y1; y++)
+        for (x = x0 + 1; x < x1; x++)
+          MS_PIX(c, x, y) = col;
+      return;
+    }
+  }
+
+  if (x1 - x0 >= y1 - y0)
+  {
+    x = (x0 + x1) / 2;
+    ms_rect(c, x0, y0, x, y1);
+    ms_rect(c, x, y0, x1, y1);
+  }
+  else
+  {
+    y = (y0 + y1) / 2;
+    ms_rect(c, x0, y0, x1, y);
+    ms_rect(c, x0, y, x1, y1);
+  }
 }
+
+
+/*! This function calculates a rectangular section of the image like
+ * mand_calc() but uses the Mariani-Silver algorithm: only the border of a
+ * rectangle is iterated. If the whole border has the same iteration count,
+ * the interior is filled with it, otherwise the rectangle is split
+ * recursively. The parameters and the return value are the same as of
+ * mand_calc().
+ */
+int mand_ms(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1)
+{
+  ms_ctx_t c;
+  int n, y;
+
+  if (x1 <= x0 || y1 <= y0)
+    return 0;
+
+  c.image = image;
+  c.realmin = realmin;
+  c.imagmax = imagmax;
+  c.deltareal = realmax - realmin;
+  c.deltaimag = imagmax - imagmin;
+  c.hres = hres;
+  c.vres = vres;
+#ifdef USE_DOUBLE
+  c.deltareal /= hres;
+  c.deltaimag /= vres;
+  c.run = 1;
+#else
+  c.run = c.deltaimag > 0 ? (vres - 1) / c.deltaimag + 1 : vres;
 #endif
 
+  // the border of a rectangle has at most 2 * (w + h) pixels
+  n = 2 * (x1 - x0 + y1 - y0);
+  if ((c.reals = malloc(n * (2 * sizeof(*c.reals) + 2 * sizeof(*c.cnt)))) == NULL)
+  {
+    perror("malloc()");
+    return -1;
+  }
+  c.imags = c.reals + n;
+  c.cnt = (int*) (c.imags + n);
+  c.pix = c.cnt + n;
+
+  // mark all pixels as not calculated
+  for (y = y0; y < y1; y++)
+    for (n = x0; n < x1; n++)
+      MS_PIX(&c, n, y) = -1;
+
+  ms_rect(&c, x0, y0, x1 - 1, y1 - 1);
+
+  free(c.reals);
+  return 0;
+}
+
+
 
-/*! This function reads the number of CPUs from /proc/cpuinfo and returns it.
- * @return The function returns the number of processors found in
- * /proc/cpuinfo. If the file does not exist, -1 is returned. If the file
- * exists but no processors are found, 0 is returned.
+/*! Calculate all pixels of a rectangular section which are marked with -1.
+ * The other pixels are left untouched. This is used for the animation mode
+ * (see anim.c) which reuses pixels of the previous frame. The parameters and
+ * the return value are the same as of mand_calc().
  */
-int get_ncpu(void)
+int mand_refine(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1)
 {
-   char buf[1024];
-   FILE *cpuinfo;
-   int n;
+  nint_t deltareal, deltaimag, *reals, *imags;
+  int *cnt, *pix, x, y, n, i;
 
-   if ((cpuinfo = fopen("/proc/cpuinfo", "r")) == NULL)
-      return -1;
+  deltareal = realmax - realmin;
+  deltaimag = imagmax - imagmin;
 
-   for (n = 0; fgets(buf, sizeof(buf), cpuinfo) != NULL;)
-      if (!strncmp(buf, "processor", 9))
-         n++;
+#ifdef USE_DOUBLE
+  deltareal /= hres;
+  deltaimag /= vres;
+#else
+  int run = deltaimag > 0 ? (vres - 1) / deltaimag + 1 : vres;
+#endif
 
-   fclose(cpuinfo);
-   return n;
+  for (n = 0, y = y0; y < y1; y++)
+    for (x = x0; x < x1; x++)
+      n += image[x + hres * (vres - y - 1)] == -1;
+  if (!n)
+    return 0;
+
+  if ((reals = malloc(n * (2 * sizeof(*reals) + 2 * sizeof(*cnt)))) == NULL)
+  {
+    perror("malloc()");
+    return -1;
+  }
+  imags = reals + n;
+  cnt = (int*) (imags + n);
+  pix = cnt + n;
+
+  for (n = 0, y = y0; y < y1; y++)
+    for (x = x0; x < x1; x++)
+      if (image[x + hres * (vres - y - 1)] == -1)
+      {
+        reals[n] = MAND_REAL(x);
+        imags[n] = MAND_IMAG(y);
+        pix[n++] = x + hres * (vres - y - 1);
+      }
+
+#ifdef WITH_SIMD
+  iterate_vec(reals, imags, cnt, n);
+#else
+  for (i = 0; i < n; i++)
+    cnt[i] = iterate(reals[i], imags[i]);
+#endif
+
+  for (i = 0; i < n; i++)
+    image[pix[i]] = cnt[i];
+
+  free(reals);
+  return 0;
 }
 
 
@@ -178,9 +586,101 @@ int fract_color(unsigned int itcnt)
 }
 
 
+/*! Create the palette of a color set. It contains the colors of all
+ * iteration counts from 0 to maxiterate_, thus coloring a pixel is a simple
+ * table lookup.
+ * @param colset Color set.
+ * @return Returns a pointer to the palette which should be freed by the
+ * caller, or NULL on error.
+ */
+uint32_t *palette_create(int colset)
+{
+   uint32_t *pal;
+   int cs = colset_;
+
+   if ((pal = malloc((maxiterate_ + 1) * sizeof(*pal))) == NULL)
+   {
+      perror("malloc()");
+      return NULL;
+   }
+
+   colset_ = colset;
+   for (int i = 0; i <= maxiterate_; i++)
+      pal[i] = fract_color(i);
+   colset_ = cs;
+
+   return pal;
+}
+
+
+/*! Build the palette of the current color set into palette_.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int palette_init(void)
+{
+   free(palette_);
+   return (palette_ = palette_create(colset_)) == NULL ? -1 : 0;
+}
+
+
+/*! Color a rectangular section of raw pixel data.
+ * @param rgb Pointer to the first pixel of the destination section.
+ * @param stride Number of pixels per row of the destination.
+ * @param image Pointer to the first pixel of the source section.
+ * @param hres Number of pixels per row of the source.
+ * @param w Width of the section.
+ * @param h Height of the section.
+ */
+void fract_colorize(uint32_t *rgb, int stride, const int *image, int hres, int w, int h)
+{
+   STAT_BEGIN(t);
+   for (int y = 0; y < h; y++, rgb += stride, image += hres)
+      for (int x = 0; x < w; x++)
+         rgb[x] = palette_[image[x]];
+   STAT_END(PHASE_COLOR, t);
+}
+
+
 static cairo_status_t cairo_write(void *closure, const unsigned char *data, unsigned int length)
 {
-   return fwrite(data, length, 1, closure) ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+   size_t n;
+
+   STAT_BEGIN(t);
+   n = fwrite(data, length, 1, closure);
+   STAT_WRITE(t);
+   return n ? CAIRO_STATUS_SUCCESS : CAIRO_STATUS_WRITE_ERROR;
+}
+
+
+/*! Write a cairo image surface to a PNG file.
+ * @param sfc Pointer to surface.
+ * @param s Name of file, "-" for stdout.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int cairo_write_surface(cairo_surface_t *sfc, const char *s)
+{
+   cairo_status_t st;
+   FILE *f;
+
+   // check for stdout
+   if (!strcmp(s, "-"))
+   {
+      f = stdout;
+   }
+   else if ((f = fopen(s, "w")) == NULL)
+   {
+      fprintf(stderr, "failed to open file %s\n", s);
+      return -1;
+   }
+
+   cairo_surface_mark_dirty(sfc);
+   STAT_BEGIN(t);
+   st = cairo_surface_write_to_png_stream(sfc, cairo_write, f);
+   STAT_END(PHASE_ENCODE, t);
+
+   if (f != stdout && fclose(f))
+      st = CAIRO_STATUS_WRITE_ERROR;
+   return st == CAIRO_STATUS_SUCCESS ? 0 : -1;
 }
 
 
@@ -192,9 +692,6 @@ static cairo_status_t cairo_write(void *closure, const unsigned char *data, unsi
 void cairo_save_image(const int *image, int hres, int vres, const char *s)
 {
    cairo_surface_t *sfc;
-   unsigned char *pdata;
-   int x, y, stride;
-   FILE *f;
 
    // safety check
    if (image == NULL || s == NULL)
@@ -203,184 +700,146 @@ void cairo_save_image(const int *image, int hres, int vres, const char *s)
       return;
    }
 
-   // check for stdout
-   if (!strcmp(s, "-"))
+   sfc = cairo_image_surface_create(CAIRO_FORMAT_RGB24, hres, vres);
+   cairo_surface_flush(sfc);
+   fract_colorize((uint32_t*) cairo_image_surface_get_data(sfc), cairo_image_surface_get_stride(sfc) / sizeof(uint32_t),
+         image, hres, hres, vres);
+   cairo_write_surface(sfc, s);
+   cairo_surface_destroy(sfc);
+}
+
+
+/*! Color an iteration map (or a section of it) and save it as PNG without
+ * calculating the image again.
+ * @param s Name of the map file.
+ * @param crop Section as string "x,y,w,h" in pixels or NULL for the full
+ * image.
+ * @param out Name of the PNG file.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int itmap_recolor(const char *s, const char *crop, const char *out)
+{
+   cairo_surface_t *sfc;
+   itmap_t *m;
+   int x = 0, y = 0, w, h;
+
+   if ((m = itmap_open(s)) == NULL)
+      return -1;
+
+   w = m->hdr->hres;
+   h = m->hdr->vres;
+   if (crop != NULL && (sscanf(crop, "%d,%d,%d,%d", &x, &y, &w, &h) != 4 ||
+            x < 0 || y < 0 || w < 1 || h < 1 || x + w > m->hdr->hres || y + h > m->hdr->vres))
    {
-      f = stdout;
+      fprintf(stderr, "crop region %s is outside of the map (%ux%u)\n", crop, m->hdr->hres, m->hdr->vres);
+      itmap_close(m);
+      return -1;
    }
-   else if ((f = fopen(s, "w")) == NULL)
+
+   maxiterate_ = m->hdr->maxiterate;
+   if (palette_init() == -1)
    {
-      fprintf(stderr, "failed to open file %s\n", s);
-      return;
+      itmap_close(m);
+      return -1;
    }
 
-   sfc = cairo_image_surface_create(CAIRO_FORMAT_RGB24, hres, vres);
-   stride = cairo_image_surface_get_stride(sfc);
+   sfc = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
    cairo_surface_flush(sfc);
-   pdata = cairo_image_surface_get_data(sfc);
-
-   for (y = 0; y < vres; y++, pdata += stride)
-      for (x = 0; x < hres; x++, image++)
-         // translate iteration counter into pixel color
-         *((int*) pdata + x) = fract_color(*image);
-
-   cairo_surface_mark_dirty(sfc);
-   cairo_surface_write_to_png_stream(sfc, cairo_write, f);
+   itmap_colorize(m, (uint32_t*) cairo_image_surface_get_data(sfc), cairo_image_surface_get_stride(sfc) / sizeof(uint32_t), x, y, w, h);
+   cairo_write_surface(sfc, out);
    cairo_surface_destroy(sfc);
 
-   fclose(f);
+   itmap_close(m);
+   return 0;
 }
 
 
-void usage(const char *s)
+/*! Transform a bbox given as center and width/height into the corners.
+ * @param b Pointer to array of 4 doubles.
+ */
+void bbox_center(double *b)
 {
-   printf("intfract v2.1 © 2015-2024 Bernhard R. Fischer, <bf@abenteuerland.at>\n"
-         "usage: %s [options] [realmin(x0)] [imagmin(y0)] [realmax(x1)] [imagmax(y1)]\n"
-         "    -C ............... Coordinates are given as x/y and w/h instead of x0/y0 and x1/y1.\n"
-         "    -c <colset> ...... Choose color set: 0 - %d\n"
-         "    -h ............... Display this help screen.\n"
-         "    -i <n> ........... Set maximum number of iterations (default = %d).\n"
-         "    -n <threads> ..... Choose number of threads (default = %d).\n"
-         "    -o <filename> .... Name of output PNG file, \"-\" for stdout.\n"
-         "    -x <width> ....... Choose image width (default = %d).\n"
-         "    -y <height> ...... Choose image height (default = %d).\n"
-         , s, NUM_COLSET - 1, MAXITERATE, nthreads_, WIDTH, HEIGHT);
-   printf("\n    defs: sizeof(nint_t) = %ld, NORM_BITS = %d, NORM_FACT = %ld\n", sizeof(nint_t), NORM_BITS, NORM_FACT);
-#ifdef USE_DOUBLE
-   printf("    USE_DOUBLE is defined\n");
-#endif
-#ifdef ASM_ITERATE
-   printf("    ASM_ITERATE is defined\n");
-#endif
+   double a = b[2] / 2;
+   b[2] = b[0] + a;
+   b[0] -= a;
+   a = b[3] / 2;
+   b[3] = b[1] + a;
+   b[1] -= a;
 }
 
 
-int main(int argc, char **argv)
+/*! Set up the coordinates and the precision of a view.
+ * @param v Pointer to view. The members hres, vres and mode must be set, if
+ * multi-precision is chosen Mariani-Silver falls back to full mode.
+ * @param sbbox Coordinates as given on the command line.
+ * @param cc 1 if sbbox contains center and width/height.
+ * @param limbs Precision: 0 = auto, 1 = native, 2 - MP_MAX_LIMBS = limbs,
+ * LIMBS_NARROW = auto with the 32 bit kernels if the view allows it.
+ * @param direct 1 to iterate every pixel in multi-precision instead of
+ * perturbation.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int view_setup(fract_view_t *v, const char * const *sbbox, int cc, int limbs, int direct)
 {
-   double bbox[] = {-2.0, -1.2, 0.7, 1.2};   // realmin, imagmin, realmax, imagmax
-   int width = WIDTH, height = HEIGHT;       // pixel resolution
-   int *image;                               // raw pixel data
-   int n;
-   char *out = "intfract.png";
-   int cc = 0;
-#ifdef WITH_THREADS
-   pthread_t fdt[MAX_THREADS];
-   int i;
-
-   nthreads_ = get_ncpu();
-   if (nthreads_ <= 0)
-      nthreads_ = NUM_THREADS;
-#endif
+   double bbox[4];
 
-   while ((n = getopt(argc, argv, "Cc:hi:n:o:x:y:")) != -1)
-      switch (n)
-      {
-         case 'h':
-            usage(argv[0]);
-            exit(EXIT_SUCCESS);
-
-         case 'C':
-            cc = 1;
-            break;
-
-         case 'c':
-            colset_ = atoi(optarg);
-            if (colset_ < 0 || colset_ >= NUM_COLSET)
-               colset_ = 0;
-            break;
-
-         case 'i':
-            maxiterate_ = atoi(optarg);
-            if (maxiterate_ <= 0)
-               maxiterate_ = MAXITERATE;
-            break;
-
-         case 'n':
-#ifdef WITH_THREADS
-            int nthreads = atoi(optarg);
-            if (nthreads >= 1 || nthreads_ <= MAX_THREADS)
-               nthreads_ = nthreads;
-#else
-            fprintf(stderr, "thread support not compiled\n");
-#endif
-            break;
-
-         case 'o':
-            out = optarg;
-            break;
-
-         case 'x':
-            width = atoi(optarg);
-            if (width <= 0)
-               width = WIDTH;
-            break;
-
-         case 'y':
-            height = atoi(optarg);
-            if (height <= 0)
-               height = HEIGHT;
-            break;
-      }
+   for (int i = 0; i < 4; i++)
+      bbox[i] = atof(sbbox[i]);
+   if (cc)
+      bbox_center(bbox);
 
-   // parse remaining command line arguments
-   for (int i = 0; optind < argc; i++, optind++)
-         bbox[i] = atof(argv[optind]);
+   v->realmin = bbox[0] * NORM_FACT;
+   v->imagmin = bbox[1] * NORM_FACT;
+   v->realmax = bbox[2] * NORM_FACT;
+   v->imagmax = bbox[3] * NORM_FACT;
 
-   // transform coordinates given as center and width/height
-   if (cc)
+   // the multi-precision code calculates the Mandelbrot set only
+   if (formula_ || julia_)
    {
-      double a = bbox[2] / 2;
-      bbox[2] = bbox[0] + a;
-      bbox[0] -= a;
-      a = bbox[3] / 2;
-      bbox[3] = bbox[1] + a;
-      bbox[1] -= a;
+      if (limbs > 1 && limbs <= MP_MAX_LIMBS)
+         fprintf(stderr, "multi-precision supports the Mandelbrot set only, using native precision\n");
+      v->limbs = 0;
    }
-
-   if ((image = malloc(width * height * sizeof(*image))) == NULL)
+   // choose precision by the pixel spacing
+   else if (!limbs || limbs == LIMBS_NARROW)
    {
-      perror("malloc()");
-      return 1;
+      // the spacing is derived in multi-precision because double cannot resolve it
+      v->limbs = MP_MAX_LIMBS;
+      mp_setup(v, sbbox, cc);
+      double dx = fabs(mp_to_double(&v->mdreal, v->limbs)), dy = fabs(mp_to_double(&v->mdimag, v->limbs));
+      v->limbs = mp_select(dx < dy ? dx : dy);
    }
-
-#ifdef WITH_TIME
-   struct timeval tv0, tv1, tv;
-   gettimeofday(&tv0, NULL);
-#endif
-
-#ifdef WITH_THREADS
-   hres_ = width;
-   vres_ = height;
-   realmin_ = bbox[0] * NORM_FACT;
-   imagmin_ = bbox[1] * NORM_FACT;
-   realmax_ = bbox[2] * NORM_FACT;
-   imagmax_ = bbox[3] * NORM_FACT;
-   image_ = image;
-
-   for (i = 0; i < nthreads_; i++)
-      pthread_create(&fdt[i], NULL, mand_thread, (void*) (intptr_t) i);
+   else
+      v->limbs = limbs < 2 || limbs > MP_MAX_LIMBS ? 0 : limbs;
+   // the 32 bit kernels may change pixels close to the boundary, thus they are
+   // used only on request; they need the pixel spacing and room for the orbit
+   // up to 4 + |c|
+   v->narrow = 0;
+   if (limbs == LIMBS_NARROW && !v->limbs && !formula_ && !julia_)
+   {
+#ifdef USE_DOUBLE
+      fprintf(stderr, "32 bit kernels not supported with USE_DOUBLE, using native precision\n");
 #else
-   // call calculation of image
-   mand_calc(image,
-         bbox[0] * NORM_FACT, bbox[1] * NORM_FACT, bbox[2] * NORM_FACT, bbox[3] * NORM_FACT,
-         width, height, 0, 1);
-#endif
-
-#ifdef WITH_THREADS
-   for (i = 0; i < nthreads_; i++)
-      pthread_join(fdt[i], NULL);
-#endif
-
-#ifdef WITH_TIME
-   gettimeofday(&tv1, NULL);
-   timersub(&tv1, &tv0, &tv);
-   fprintf(stderr, "%ld.%06ld\n", tv.tv_sec, tv.tv_usec);
+      double d = fmin(fabs(bbox[2] - bbox[0]) / v->hres, fabs(bbox[3] - bbox[1]) / v->vres);
+      double c = 4 + sqrt(fmax(bbox[0] * bbox[0], bbox[2] * bbox[2]) + fmax(bbox[1] * bbox[1], bbox[3] * bbox[3]));
+      v->narrow = d * (1 << NORM_BITS32) >= 1 << NARROW_GUARD && c * c * (1 << NORM_BITS32) < 0x7fffffff;
 #endif
+   }
+   if (!formula_ && !julia_)
+      kernel_narrow(v->narrow);
 
-   // save image to disk
-   cairo_save_image(image, width, height, out);
+   if (v->limbs)
+   {
+      mp_setup(v, sbbox, cc);
+      if (v->mode == MODE_MARIANI)
+      {
+         fprintf(stderr, "Mariani-Silver not supported in multi-precision, using full mode\n");
+         v->mode = MODE_FULL;
+      }
+      if (!direct && perturb_setup(v) == -1)
+         return -1;
+   }
 
-   free(image);
    return 0;
 }
 
@@ -28,6 +28,7 @@
 #define MAX_THREADS 32
 #define NUM_THREADS 4
 #else
+#define MAX_THREADS 1
 #define NUM_THREADS 1
 #endif
 
@@ -38,6 +39,12 @@
 // maximum number of iterations of the inner loop
 #define MAXITERATE 64
 
+// width and height of the tiles which are distributed to the threads
+#define TILE_SIZE 64
+
+// default number of tiles in the memory cache of the tile server
+#define SRV_CACHE 256
+
 
 #define IT8(x) ((x) * 255 / maxiterate_)
 
@@ -69,14 +76,284 @@ typedef long nint_t;
 #endif
 #endif
 
+//! fraction bits of the packed 32 bit kernels (see iterate32.c)
+#define NORM_BITS32 24
+//! with -l LIMBS_NARROW the 32 bit kernels are used if the pixel spacing is at least 2^NARROW_GUARD units of them
+#define NARROW_GUARD 12
+//! precision argument (-l) which enables the 32 bit kernels
+#define LIMBS_NARROW 32
+
 #ifndef __ASSEMBLER__
-// prototype for iterate()
-int iterate(nint_t real0, nint_t imag0);
-extern int maxiterate_;
+#include <stdint.h>
+#include <stdio.h>
+
+/*! The parameters of a render are thread-local, thus several renders with
+ * different parameters can run in parallel (see lib.c). The threads of the
+ * pool take them over from the thread which submits a job (see pool.c).
+ */
+extern __thread int maxiterate_;
+extern __thread int interior_;
+extern __thread int colset_;
+extern __thread uint32_t *palette_;
+
+/* from kernel.c */
+//! scalar and batch kernel selected by kernel_init()
+extern __thread int (*iterate)(nint_t real0, nint_t imag0);
+extern __thread void (*iterate_vec)(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+int kernel_init(const char *names);
+void kernel_narrow(int on);
+const char *kernel_name(void);
+void kernel_names(char *buf, size_t len);
+const char *kernel_get(int i, int *vec, int *narrow);
+void kernel_list(FILE *f);
+
+/* from formula.c */
+//! formula (0 = Mandelbrot set) and Julia set, see formula_init()
+extern __thread int formula_;
+extern __thread int julia_;
+extern __thread nint_t julia_real_, julia_imag_;
+int formula_init(const char *name, const char *julia);
+void formula_select(void);
+void formula_list(FILE *f);
+
+/* from iteratel.c or iterated.c */
+int interior(nint_t real0, nint_t imag0);
+int iterate_imul128(nint_t real0, nint_t imag0);
+int iterate_int128(nint_t real0, nint_t imag0);
+int iterate_long(nint_t real0, nint_t imag0);
+int iterate_double(nint_t real0, nint_t imag0);
+
+/* from iterate32.c */
+int iterate_int32(nint_t real0, nint_t imag0);
+void iterate_vec32_avx2(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+void iterate_vec32_avx512(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+
+/* from iterate.S */
+int iterate_asm(nint_t real0, nint_t imag0);
+int iterate_asm_stack(nint_t real0, nint_t imag0);
+
+/* from iteratev.c */
+void iterate_vec_scalar(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+void iterate_vec_avx2(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+void iterate_vec_avx512(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+void iterate_vec_ifma(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+
+/*! Multi-precision fixed point number (see mpfix.c). It consists of up to
+ * MP_MAX_LIMBS 64 bit limbs, least significant limb first. The upper
+ * MP_INT_BITS bits hold sign and integer part.
+ */
+#define MP_MAX_LIMBS 4
+#define MP_INT_BITS 8
+#define MP_FRAC(n) (64 * (n) - MP_INT_BITS)
+
+typedef struct mpfix
+{
+   uint64_t l[MP_MAX_LIMBS];
+} mpfix_t;
+
+//! header of an iteration map file, see itmap.c
+typedef struct itmap_hdr
+{
+   char magic[8];
+   uint32_t version, hdrsize;
+   //! pixel resolution, tile size and bytes per pixel
+   uint32_t hres, vres, tile, bpp;
+   uint32_t maxiterate, norm_bits;
+   //! 1 if bbox contains center and width/height
+   uint32_t cc;
+   //! iteration kernel which calculated the map
+   char kernel[16];
+   //! coordinates as given on the command line
+   char bbox[4][64];
+} itmap_hdr_t;
+
+//! memory mapped iteration map
+typedef struct itmap
+{
+   itmap_hdr_t *hdr;
+   unsigned char *data;
+   size_t size;
+   //! number of tiles per row
+   int ntx;
+} itmap_t;
+
+//! color sets
+enum {COLSET_RED, COLSET_GREEN_BLUE, COLSET_RED_YELLOW, COLSET_BLUE, COLSET_BLACK_WHITE, NUM_COLSET};
+
+//! render modes
+enum {MODE_FULL, MODE_MARIANI, MODE_REFINE, NUM_MODE};
+
+//! geometry of the image to calculate
+typedef struct fract_view
+{
+   //! pointer to image array of size hres * vres elements
+   int *image;
+   //! if not NULL, the tiles are colored into this buffer instead of image
+   uint32_t *rgb;
+   //! number of pixels per row of rgb
+   int stride;
+   //! if not NULL, the iteration counts are stored into this map
+   itmap_t *map;
+   //! coordinates of the image within the complex plane
+   nint_t realmin, imagmin, realmax, imagmax;
+   //! pixel resolution
+   int hres, vres;
+   //! render mode, MODE_FULL iterates every pixel
+   int mode;
+   //! number of limbs for multi-precision, 0 uses the native nint_t
+   int limbs;
+   //! 1 if the packed 32 bit kernels are used (limbs = 0)
+   int narrow;
+   //! multi-precision coordinates of pixel (0, 0) and pixel spacing
+   mpfix_t mrealmin, mimagmax, mdreal, mdimag;
+   //! reference orbit for perturbation (see perturb.c), NULL if not used
+   double *zref;
+   //! length of the reference orbit and pixel of the reference point
+   int nref, xref, yref;
+   //! pixel spacing as double
+   double ddreal, ddimag;
+} fract_view_t;
+
+//! thread-local parameters of a render, see param_get()
+typedef struct fract_param
+{
+   int maxiterate, interior, colset, formula, julia;
+   nint_t julia_real, julia_imag;
+   uint32_t *palette;
+   int (*iterate)(nint_t real0, nint_t imag0);
+#ifdef WITH_SIMD
+   void (*iterate_vec)(const nint_t *real0, const nint_t *imag0, int *cnt, int n);
+#endif
+} fract_param_t;
+
+/* from intfract.c */
+void param_get(fract_param_t *p);
+void param_set(const fract_param_t *p);
+void bbox_center(double *b);
+int mand_calc(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1);
+int mand_ms(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1);
+int mand_pixel(nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x, int y);
+void mand_row(const fract_view_t *v, int *cnt, int y, int x0, int step, int n);
+int mand_refine(int *image, nint_t realmin, nint_t imagmin, nint_t realmax, nint_t imagmax, int hres, int vres, int x0, int y0, int x1, int y1);
+int fract_color(unsigned int itcnt);
+uint32_t *palette_create(int colset);
+int palette_init(void);
+void fract_colorize(uint32_t *rgb, int stride, const int *image, int hres, int w, int h);
+void cairo_save_image(const int *image, int hres, int vres, const char *s);
+#ifdef CAIRO_H
+int cairo_write_surface(cairo_surface_t *sfc, const char *s);
+#endif
+int itmap_recolor(const char *s, const char *crop, const char *out);
+int view_setup(fract_view_t *v, const char * const *sbbox, int cc, int limbs, int direct);
+
+/* from itmap.c */
+itmap_t *itmap_create(const char *s, const fract_view_t *v, const char * const *bbox, int cc);
+itmap_t *itmap_open(const char *s);
+void itmap_close(itmap_t *m);
+void itmap_put(itmap_t *m, const fract_view_t *v, int x0, int y0, int x1, int y1);
+void itmap_colorize(const itmap_t *m, uint32_t *rgb, int stride, int x0, int r0, int w, int h);
+
+/* from anim.c */
+//! easing curves of the animation
+enum {EASE_LINEAR, EASE_SMOOTH, EASE_IN, EASE_OUT, NUM_EASE};
+int anim_ease_by_name(const char *s);
+int anim_render(fract_view_t *v, const double *b0, const double *b1, int frames, int ease, int nthreads, const char *out);
+
+/* from server.c */
+int server_run(const char *addr, const double *bbox, const char *dir, int maxtiles, int nthreads);
+int srv_socket(const char *addr, int server);
+
+/* from stats.c */
+//! phases of the render which are timed
+enum {PHASE_COMPUTE, PHASE_COLOR, PHASE_ENCODE, PHASE_WRITE, NUM_PHASE};
+//! slot of the writer thread, slot 0 is used by threads outside of the pool
+//! and slot 1 + pool_self() by each thread of the pool
+#define STAT_IO (MAX_THREADS + 1)
+//! number of buckets of the escape histogram
+#define STAT_HIST 33
+#ifdef WITH_STATS
+void stat_thread(int idx);
+double stat_time(void);
+void stat_phase(int phase, double t);
+void stat_count(const int *cnt, int n);
+void stat_report(const char *s);
+#define STAT_THREAD(i) stat_thread(i)
+#define STAT_COUNT(cnt, n) stat_count(cnt, n)
+#define STAT_BEGIN(t) double t = stat_time()
+#define STAT_END(p, t) stat_phase(p, stat_time() - (t))
+//! time spent in write() is moved from the encode to the write phase
+#define STAT_WRITE(t) do { double d_ = stat_time() - (t); stat_phase(PHASE_WRITE, d_); stat_phase(PHASE_ENCODE, -d_); } while (0)
+#else
+#define STAT_THREAD(i)
+#define STAT_COUNT(cnt, n)
+#define STAT_BEGIN(t)
+#define STAT_END(p, t)
+#define STAT_WRITE(t)
+#endif
+
+/* from bench.c */
+int bench_run(int runs, const char *kernel, int nthreads);
+
+/* from sched.c */
+double sched_render(const fract_view_t *v, int y0, int y1, int nthreads);
+int sched_start(const fract_view_t *v, int nthreads, void (*done)(void *arg, double imbalance), void *arg);
+
+/* from pool.c */
+int pool_run(void (*func)(void *arg, int idx), void *arg, int n);
+int pool_start(void (*func)(void *arg, int idx), void *arg, int n, void (*done)(void *arg));
+int pool_self(void);
+
+/* from topo.c */
+int get_ncpu(void);
+int topo_affinity(void);
+int topo_pinned(void);
+void topo_pin(int idx);
+void *topo_alloc(size_t size);
+void topo_free(void *buf, size_t size);
+
+/* from stream.c */
+typedef struct stream stream_t;
+stream_t *stream_open(const char *s, int hres, int vres);
+int stream_put(stream_t *st, const int *band, int rows);
+int stream_close(stream_t *st);
+int stream_render(fract_view_t *v, int band, int nthreads, const char *s);
+
+/* from aa.c */
+int aa_render(const fract_view_t *v, uint32_t *rgb, int stride, int samples, int threshold, int nthreads);
+
+/* from maxiter.c */
+int maxiter_auto(fract_view_t *v, int direct);
+
+/* from batch.c */
+int batch_run(const char *manifest, int cc, int limbs, int direct, int mode, int nthreads);
+
+/* from prog.c */
+int prog_render(fract_view_t *v, double interval, int nthreads, const char *out);
+
+/* from dist.c */
+int dist_worker(const char *addr, int nthreads);
+int dist_render(fract_view_t *v, const char * const *sbbox, int cc, int direct, const char *workers, int band, int nthreads, const char *out);
+
+/* from mpfix.c */
+int iterate_mp(const mpfix_t *real0, const mpfix_t *imag0, int n);
+double mp_to_double(const mpfix_t *a, int n);
+void mp_from_str(mpfix_t *a, const char *s, int n);
+int mp_select(double spacing);
+void mp_setup(fract_view_t *v, const char * const *bbox, int cc);
+void mand_mp(const fract_view_t *v, int x0, int y0, int x1, int y1);
+int mand_mp_pixel(const fract_view_t *v, int x, int y);
+int mp_orbit(const fract_view_t *v, int x, int y, double *z);
+
+/* from perturb.c */
+int perturb_setup(fract_view_t *v);
+void perturb_free(fract_view_t *v);
+void mand_pt(const fract_view_t *v, int x0, int y0, int x1, int y1);
+int mand_pt_pixel(const fract_view_t *v, int x, int y);
 
 /* from imul128.S */
 nint_t sqr128shr(nint_t a);
 nint_t imul128shr(nint_t a, nint_t b);
+void mpmul(uint64_t *r, const uint64_t *a, const uint64_t *b, int n);
 #endif
 
 #endif
@@ -0,0 +1,345 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file iterate32.c
+ * This file contains the packed 32 bit kernels. They use a fixed point format
+ * of 32 bit integers with NORM_BITS32 fraction bits, which is sufficient for
+ * views with a large pixel spacing (overviews, thumbnails). The products are
+ * calculated with 64 bits and shifted back, thus no bits are lost before the
+ * shift. The integer part has to hold the orbit until it escapes: after the
+ * escape check |z|^2 <= 4, thus the next point is at most 4 + |c| and its
+ * square must fit into 31 bits. view_setup() selects these kernels only on
+ * request (-l 32) and only if the pixel spacing and the bbox of the view allow
+ * it, never in the double build.
+ *
+ * The batch kernels hold twice as many pixels per vector register as the 64
+ * bit kernels: 8 lanes with AVX2 and 16 lanes with AVX-512. They return the
+ * same iteration counts as the scalar kernel iterate_int32(). Pixels close to
+ * the boundary may get different counts than with the 64 bit kernels because
+ * of the lower precision, this is why the tier is not chosen by default.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <math.h>
+
+#include "intfract.h"
+
+#ifdef WITH_SIMD
+#include <immintrin.h>
+#endif
+
+
+//! conversion of coordinates to the 32 bit format, rounded down
+#ifdef USE_DOUBLE
+#define TO32(x) ((int32_t) floor((x) * (1 << NORM_BITS32)))
+#else
+#define TO32(x) ((int32_t) ((x) >> (NORM_BITS - NORM_BITS32)))
+#endif
+
+//! multiply two numbers and shift the 64 bit product right by s bits
+#define MUL32(a, b, s) ((int32_t) (((int64_t) (a) * (b)) >> (s)))
+
+
+/*! This is the scalar kernel "c-int32". It contains the iteration loop with
+ * 32 bit fixed point numbers.
+ * @param real0 Real coordinate of pixel within the complex plane.
+ * @param imag0 Imaginary coordinate of the pixel.
+ * @return Returns the number of iterations to reach the break condition.
+ */
+int iterate_int32(nint_t real0, nint_t imag0)
+{
+   int32_t cr = TO32(real0), ci = TO32(imag0), real = cr, imag = ci, realq, imagq;
+   int i;
+
+#ifdef WITH_INTERIOR
+   // Brent's cycle detection, see iterate_periodic()
+   if (interior_)
+   {
+      int32_t realc = real, imagc = imag;
+      int k, period;
+
+      if (interior(real0, imag0))
+         return maxiterate_;
+
+      for (i = 0, k = period = 1; i < maxiterate_; i++)
+      {
+         realq = MUL32(real, real, NORM_BITS32);
+         imagq = MUL32(imag, imag, NORM_BITS32);
+
+         if ((realq + imagq) > 4 << NORM_BITS32)
+            break;
+
+         imag = MUL32(real, imag, NORM_BITS32 - 1) + ci;
+         real = realq - imagq + cr;
+
+         if (real == realc && imag == imagc)
+            return maxiterate_;
+
+         if (!--k)
+         {
+            k = period <<= 1;
+            realc = real;
+            imagc = imag;
+         }
+      }
+      return i;
+   }
+#endif
+
+   for (i = 0; i < maxiterate_; i++)
+   {
+      realq = MUL32(real, real, NORM_BITS32);
+      imagq = MUL32(imag, imag, NORM_BITS32);
+
+      if ((realq + imagq) > 4 << NORM_BITS32)
+         break;
+
+      imag = MUL32(real, imag, NORM_BITS32 - 1) + ci;
+      real = realq - imagq + cr;
+   }
+   return i;
+}
+
+
+#ifdef WITH_SIMD
+//! maximum number of lanes
+#define MAX_LANES32 16
+
+//! state of the lanes of the batch kernels, see vec_lanes_t of iteratev.c
+typedef struct vec32_lanes
+{
+   int32_t cr[MAX_LANES32], ci[MAX_LANES32], zr[MAX_LANES32], zi[MAX_LANES32];
+   int32_t sr[MAX_LANES32], si[MAX_LANES32], it[MAX_LANES32];
+   int32_t sk[MAX_LANES32], sp[MAX_LANES32];
+   int idx[MAX_LANES32];
+   int active;
+   int next;
+} __attribute__((aligned(64))) vec32_lanes_t;
+
+
+/*! Finish lanes and refill them with the next pixels of the batch, see
+ * vec_refill() of iteratev.c.
+ */
+static void vec32_refill(vec32_lanes_t *l, int lanes, int m, int cyc, const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   for (int k = 0; k < lanes; k++)
+   {
+      if (!(m & (1 << k)))
+         continue;
+
+      if (l->active & (1 << k))
+         cnt[l->idx[k]] = cyc & (1 << k) ? maxiterate_ : l->it[k];
+
+#ifdef WITH_INTERIOR
+      if (interior_)
+         for (; l->next < n && interior(real0[l->next], imag0[l->next]); l->next++)
+            cnt[l->next] = maxiterate_;
+#endif
+
+      if (l->next < n)
+      {
+         l->cr[k] = l->zr[k] = l->sr[k] = TO32(real0[l->next]);
+         l->ci[k] = l->zi[k] = l->si[k] = TO32(imag0[l->next]);
+         l->idx[k] = l->next++;
+         l->active |= 1 << k;
+      }
+      else
+      {
+         l->cr[k] = l->ci[k] = l->zr[k] = l->zi[k] = l->sr[k] = l->si[k] = 0;
+         l->active &= ~(1 << k);
+      }
+      l->it[k] = 0;
+      l->sk[k] = l->sp[k] = 1;
+   }
+}
+
+
+/* The vector multiplications: the even lanes are multiplied to 64 bit
+ * products in place, the odd lanes after shifting them down. The low 32 bits
+ * of the shifted products are identical for logical and arithmetic shifts
+ * because s < 32, they are merged back into the lanes.
+ */
+#define MUL32_AVX2(a, b, s) _mm256_blend_epi32( \
+      _mm256_srli_epi64(_mm256_mul_epi32(a, b), s), \
+      _mm256_slli_epi64(_mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)), 32 - (s)), 0xaa)
+
+#define MUL32_AVX512(a, b, s) _mm512_mask_blend_epi32(0xaaaa, \
+      _mm512_srli_epi64(_mm512_mul_epi32(a, b), s), \
+      _mm512_slli_epi64(_mm512_mul_epi32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32)), 32 - (s)))
+
+
+/*! Iterate a batch of pixels, 8 at a time with AVX2 and 32 bit lanes.
+ */
+__attribute__((target("avx2")))
+void iterate_vec32_avx2(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   vec32_lanes_t l = {.active = 0, .next = 0};
+   __m256i vcr, vci, vzr, vzi, vsr, vsi, vit, vzrq, vziq, done;
+   const __m256i four = _mm256_set1_epi32(4 << NORM_BITS32), one = _mm256_set1_epi32(1);
+   const __m256i last = _mm256_set1_epi32(maxiterate_ - 1);
+   int m, cyc = 0;
+#ifdef WITH_INTERIOR
+   __m256i vsk, vsp, renew;
+   int per = interior_;
+#endif
+
+   vec32_refill(&l, 8, 0xff, 0, real0, imag0, cnt, n);
+   if (!l.active)
+      return;
+
+   for (;;)
+   {
+      vcr = _mm256_load_si256((__m256i*) l.cr);
+      vci = _mm256_load_si256((__m256i*) l.ci);
+      vzr = _mm256_load_si256((__m256i*) l.zr);
+      vzi = _mm256_load_si256((__m256i*) l.zi);
+      vsr = _mm256_load_si256((__m256i*) l.sr);
+      vsi = _mm256_load_si256((__m256i*) l.si);
+      vit = _mm256_load_si256((__m256i*) l.it);
+#ifdef WITH_INTERIOR
+      vsk = _mm256_load_si256((__m256i*) l.sk);
+      vsp = _mm256_load_si256((__m256i*) l.sp);
+#endif
+      cyc = 0;
+
+      for (;;)
+      {
+         vzrq = MUL32_AVX2(vzr, vzr, NORM_BITS32);
+         vziq = MUL32_AVX2(vzi, vzi, NORM_BITS32);
+
+         // lane is finished if it escaped, reached maxiterate_ or is periodic
+         done = _mm256_or_si256(
+               _mm256_cmpgt_epi32(_mm256_add_epi32(vzrq, vziq), four),
+               _mm256_cmpgt_epi32(vit, last));
+
+         if ((m = (_mm256_movemask_ps(_mm256_castsi256_ps(done)) | cyc) & l.active))
+            break;
+
+         vzi = _mm256_add_epi32(MUL32_AVX2(vzr, vzi, NORM_BITS32 - 1), vci);
+         vzr = _mm256_add_epi32(_mm256_sub_epi32(vzrq, vziq), vcr);
+         vit = _mm256_add_epi32(vit, one);
+
+#ifdef WITH_INTERIOR
+         if (per)
+         {
+            cyc = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(
+                        _mm256_cmpeq_epi32(vzr, vsr), _mm256_cmpeq_epi32(vzi, vsi))));
+            vsk = _mm256_sub_epi32(vsk, one);
+            renew = _mm256_cmpeq_epi32(vsk, _mm256_setzero_si256());
+            vsp = _mm256_blendv_epi8(vsp, _mm256_slli_epi32(vsp, 1), renew);
+            vsk = _mm256_blendv_epi8(vsk, vsp, renew);
+            vsr = _mm256_blendv_epi8(vsr, vzr, renew);
+            vsi = _mm256_blendv_epi8(vsi, vzi, renew);
+         }
+#endif
+      }
+
+      _mm256_store_si256((__m256i*) l.zr, vzr);
+      _mm256_store_si256((__m256i*) l.zi, vzi);
+      _mm256_store_si256((__m256i*) l.sr, vsr);
+      _mm256_store_si256((__m256i*) l.si, vsi);
+      _mm256_store_si256((__m256i*) l.it, vit);
+#ifdef WITH_INTERIOR
+      _mm256_store_si256((__m256i*) l.sk, vsk);
+      _mm256_store_si256((__m256i*) l.sp, vsp);
+#endif
+
+      vec32_refill(&l, 8, m, cyc, real0, imag0, cnt, n);
+      if (!l.active)
+         break;
+   }
+}
+
+
+/*! Iterate a batch of pixels, 16 at a time with AVX-512 and 32 bit lanes.
+ */
+__attribute__((target("avx512f")))
+void iterate_vec32_avx512(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   vec32_lanes_t l = {.active = 0, .next = 0};
+   __m512i vcr, vci, vzr, vzi, vsr, vsi, vit, vzrq, vziq;
+   const __m512i four = _mm512_set1_epi32(4 << NORM_BITS32), one = _mm512_set1_epi32(1);
+   const __m512i max = _mm512_set1_epi32(maxiterate_);
+   int m, cyc = 0;
+#ifdef WITH_INTERIOR
+   __m512i vsk, vsp;
+   __mmask16 renew;
+   int per = interior_;
+#endif
+
+   vec32_refill(&l, 16, 0xffff, 0, real0, imag0, cnt, n);
+   if (!l.active)
+      return;
+
+   for (;;)
+   {
+      vcr = _mm512_load_si512(l.cr);
+      vci = _mm512_load_si512(l.ci);
+      vzr = _mm512_load_si512(l.zr);
+      vzi = _mm512_load_si512(l.zi);
+      vsr = _mm512_load_si512(l.sr);
+      vsi = _mm512_load_si512(l.si);
+      vit = _mm512_load_si512(l.it);
+#ifdef WITH_INTERIOR
+      vsk = _mm512_load_si512(l.sk);
+      vsp = _mm512_load_si512(l.sp);
+#endif
+      cyc = 0;
+
+      for (;;)
+      {
+         vzrq = MUL32_AVX512(vzr, vzr, NORM_BITS32);
+         vziq = MUL32_AVX512(vzi, vzi, NORM_BITS32);
+
+         if ((m = (_mm512_cmpgt_epi32_mask(_mm512_add_epi32(vzrq, vziq), four)
+               | _mm512_cmpge_epi32_mask(vit, max) | cyc) & l.active))
+            break;
+
+         vzi = _mm512_add_epi32(MUL32_AVX512(vzr, vzi, NORM_BITS32 - 1), vci);
+         vzr = _mm512_add_epi32(_mm512_sub_epi32(vzrq, vziq), vcr);
+         vit = _mm512_add_epi32(vit, one);
+
+#ifdef WITH_INTERIOR
+         if (per)
+         {
+            cyc = _mm512_cmpeq_epi32_mask(vzr, vsr) & _mm512_cmpeq_epi32_mask(vzi, vsi);
+            vsk = _mm512_sub_epi32(vsk, one);
+            renew = _mm512_cmpeq_epi32_mask(vsk, _mm512_setzero_si512());
+            vsp = _mm512_mask_slli_epi32(vsp, renew, vsp, 1);
+            vsk = _mm512_mask_mov_epi32(vsk, renew, vsp);
+            vsr = _mm512_mask_mov_epi32(vsr, renew, vzr);
+            vsi = _mm512_mask_mov_epi32(vsi, renew, vzi);
+         }
+#endif
+      }
+
+      _mm512_store_si512(l.zr, vzr);
+      _mm512_store_si512(l.zi, vzi);
+      _mm512_store_si512(l.sr, vsr);
+      _mm512_store_si512(l.si, vsi);
+      _mm512_store_si512(l.it, vit);
+#ifdef WITH_INTERIOR
+      _mm512_store_si512(l.sk, vsk);
+      _mm512_store_si512(l.sp, vsp);
+#endif
+
+      vec32_refill(&l, 16, m, cyc, real0, imag0, cnt, n);
+      if (!l.active)
+         break;
+   }
+}
+#endif
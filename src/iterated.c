@@ -24,16 +24,87 @@
 
 
 #ifdef USE_DOUBLE
-/*! This function contains the iteration loop using integer arithmetics.
+#ifdef WITH_INTERIOR
+/*! This function tests if a point is within the main cardioid or the period-2
+ * bulb of the Mandelbrot set. All points within these areas never escape.
+ * @param real0 Real coordinate of pixel within the complex plane.
+ * @param imag0 Imaginary coordinate of the pixel.
+ * @return Returns 1 if the point is inside, otherwise 0.
+ */
+int interior(nint_t real0, nint_t imag0)
+{
+   nint_t x, q, imagq;
+
+   imagq = imag0 * imag0;
+
+   // period-2 bulb: (x + 1)^2 + y^2 <= 1/16
+   x = real0 + 1;
+   if (x * x + imagq <= 0.0625)
+      return 1;
+
+   // main cardioid: q = (x - 1/4)^2 + y^2, q * (q + x - 1/4) <= y^2 / 4
+   x = real0 - 0.25;
+   q = x * x + imagq;
+   return q * (q + x) <= imagq * 0.25;
+}
+
+
+/*! This is iterate() with Brent's cycle detection. A checkpoint of the orbit
+ * is saved at growing intervals (powers of 2). If the orbit returns exactly to
+ * the checkpoint, it is periodic and never escapes.
+ */
+static int iterate_periodic(nint_t real0, nint_t imag0)
+{
+   nint_t realq, imagq, real, imag, realc, imagc;
+   int i, k, period;
+
+   if (interior(real0, imag0))
+      return maxiterate_;
+
+   realc = real = real0;
+   imagc = imag = imag0;
+   for (i = 0, k = period = 1; i < maxiterate_; i++)
+   {
+     realq = real * real;
+     imagq = imag * imag;
+
+     if ((realq + imagq) > (nint_t) 4)
+        break;
+
+     imag = real * imag * 2 + imag0;
+     real = realq - imagq + real0;
+
+     if (real == realc && imag == imagc)
+        return maxiterate_;
+
+     if (!--k)
+     {
+        k = period <<= 1;
+        realc = real;
+        imagc = imag;
+     }
+   }
+   return i;
+}
+#endif
+
+
+/*! This function contains the iteration loop using floating point
+ * arithmetics, it is the kernel "c-double".
  * @param real0 Real coordinate of pixel within the complex plane.
  * @param imag0 Imaginary coordinate of the pixel.
  * @return Returns the number of iterations to reach the break condition.
  */
-int iterate(nint_t real0, nint_t imag0)
+int iterate_double(nint_t real0, nint_t imag0)
 {
    nint_t realq, imagq, real, imag;
    int i;
 
+#ifdef WITH_INTERIOR
+   if (interior_)
+      return iterate_periodic(real0, imag0);
+#endif
+
    real = real0;
    imag = imag0;
    for (i = 0; i < maxiterate_; i++)
@@ -14,7 +14,7 @@
  */
 
 /* \file iteratel.c
- * This file containes the iterate() function in C with integer math.
+ * This file containes the iterate() kernels in C with integer math.
  *
  * @author Bernhard R. Fischer
  * @version 2025/07/25
@@ -23,49 +23,177 @@
 #include "intfract.h"
 
 
-#if !defined(USE_DOUBLE) && !defined(ASM_ITERATE)
-/*! This function contains the iteration loop using integer arithmetics.
+#ifndef USE_DOUBLE
+#ifdef WITH_INTERIOR
+/*! This function tests if a point is within the main cardioid or the period-2
+ * bulb of the Mandelbrot set. All points within these areas never escape.
+ * The test is done in fixed point arithmetics with a 128 bit intermediate
+ * product.
  * @param real0 Real coordinate of pixel within the complex plane.
  * @param imag0 Imaginary coordinate of the pixel.
+ * @return Returns 1 if the point is inside, otherwise 0.
+ */
+int interior(nint_t real0, nint_t imag0)
+{
+   nint_t x, q, imagq;
+
+   imagq = ((__int128_t) imag0 * imag0) >> NORM_BITS;
+
+   // period-2 bulb: (x + 1)^2 + y^2 <= 1/16
+   x = real0 + NORM_FACT;
+   if ((((__int128_t) x * x) >> NORM_BITS) + imagq <= NORM_FACT / 16)
+      return 1;
+
+   // main cardioid: q = (x - 1/4)^2 + y^2, q * (q + x - 1/4) <= y^2 / 4
+   x = real0 - NORM_FACT / 4;
+   q = (((__int128_t) x * x) >> NORM_BITS) + imagq;
+   return (((__int128_t) q * (q + x)) >> NORM_BITS) <= imagq / 4;
+}
+#endif
+#endif
+
+
+#ifndef USE_DOUBLE
+//! multiplication variants of the kernels
+enum {MUL_LONG, MUL_IMUL128, MUL_INT128};
+
+
+/*! Square a number and shift it back to the fixed point format.
+ * @param a Number.
+ * @param mul Multiplication variant, this is a constant thus the switch is
+ * resolved at compile time.
+ */
+static inline nint_t sqr_shr(nint_t a, int mul)
+{
+   switch (mul)
+   {
+#ifdef WITH_IMUL128
+      case MUL_IMUL128:
+         return sqr128shr(a);
+      case MUL_INT128:
+         return ((__int128_t) a * a) >> NORM_BITS;
+#endif
+      default:
+         return (a * a) >> NORM_BITS;
+   }
+}
+
+
+/*! Multiply two numbers and shift the product back to the fixed point
+ * format, the result is doubled.
+ */
+static inline nint_t mul2_shr(nint_t a, nint_t b, int mul)
+{
+   switch (mul)
+   {
+#ifdef WITH_IMUL128
+      case MUL_IMUL128:
+         return imul128shr(a, b);
+      case MUL_INT128:
+         return ((__int128_t) a * b) >> (NORM_BITS - 1);
+#endif
+      default:
+         return (a * b) >> (NORM_BITS - 1);
+   }
+}
+
+
+#ifdef WITH_INTERIOR
+/*! This is iterate() with Brent's cycle detection. A checkpoint of the orbit
+ * is saved at growing intervals (powers of 2). If the orbit returns exactly to
+ * the checkpoint, it is periodic and never escapes.
+ */
+static inline __attribute__((always_inline)) int iterate_periodic(nint_t real0, nint_t imag0, int mul)
+{
+   nint_t realq, imagq, real, imag, realc, imagc;
+   int i, k, period;
+
+   if (interior(real0, imag0))
+      return maxiterate_;
+
+   realc = real = real0;
+   imagc = imag = imag0;
+   for (i = 0, k = period = 1; i < maxiterate_; i++)
+   {
+      realq = sqr_shr(real, mul);
+      imagq = sqr_shr(imag, mul);
+
+      if ((realq + imagq) > (nint_t) 4 * NORM_FACT)
+         break;
+
+      imag = mul2_shr(real, imag, mul) + imag0;
+      real = realq - imagq + real0;
+
+      if (real == realc && imag == imagc)
+         return maxiterate_;
+
+      if (!--k)
+      {
+         k = period <<= 1;
+         realc = real;
+         imagc = imag;
+      }
+   }
+   return i;
+}
+#endif
+
+
+/*! This function contains the iteration loop using integer arithmetics. It
+ * is instantiated once for each multiplication variant below.
+ * @param real0 Real coordinate of pixel within the complex plane.
+ * @param imag0 Imaginary coordinate of the pixel.
+ * @param mul Multiplication variant.
  * @return Returns the number of iterations to reach the break condition.
  */
-int iterate(nint_t real0, nint_t imag0)
+static inline __attribute__((always_inline)) int iterate_c(nint_t real0, nint_t imag0, int mul)
 {
    nint_t realq, imagq, real, imag;
    int i;
 
+#ifdef WITH_INTERIOR
+   if (interior_)
+      return iterate_periodic(real0, imag0, mul);
+#endif
+
    real = real0;
    imag = imag0;
    for (i = 0; i < maxiterate_; i++)
    {
-#ifdef WITH_IMUL128
-#ifdef GCCMUL128
-      realq = ((__int128_t) real * real) >> NORM_BITS;
-      imagq = ((__int128_t) imag * imag) >> NORM_BITS;
-#else
-      realq = sqr128shr(real);
-      imagq = sqr128shr(imag);
-#endif
-#else
-     realq = (real * real) >> NORM_BITS;
-     imagq = (imag * imag) >> NORM_BITS;
-#endif
+      realq = sqr_shr(real, mul);
+      imagq = sqr_shr(imag, mul);
 
-     if ((realq + imagq) > (nint_t) 4 * NORM_FACT)
-        break;
+      if ((realq + imagq) > (nint_t) 4 * NORM_FACT)
+         break;
 
-#ifdef WITH_IMUL128
-#ifdef GCCMUL128
-      imag = (((__int128_t) real * imag) >> (NORM_BITS - 1)) + imag0;
-#else
-      imag = imul128shr(real, imag) + imag0;
-#endif
-#else
-     imag = ((real * imag) >> (NORM_BITS - 1)) + imag0;
-#endif
-     real = realq - imagq + real0;
+      imag = mul2_shr(real, imag, mul) + imag0;
+      real = realq - imagq + real0;
    }
    return i;
 }
-#endif
 
+
+#ifdef WITH_IMUL128
+/*! Kernel using the 128 bit multiplication of imul128.S.
+ */
+int iterate_imul128(nint_t real0, nint_t imag0)
+{
+   return iterate_c(real0, imag0, MUL_IMUL128);
+}
+
+
+/*! Kernel using the 128 bit integer type of gcc.
+ */
+int iterate_int128(nint_t real0, nint_t imag0)
+{
+   return iterate_c(real0, imag0, MUL_INT128);
+}
+#else
+/*! Kernel using the single precision 64 bit multiplication.
+ */
+int iterate_long(nint_t real0, nint_t imag0)
+{
+   return iterate_c(real0, imag0, MUL_LONG);
+}
+#endif
+#endif
@@ -0,0 +1,401 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file iteratev.c
+ * This file contains the batch kernels of iterate_vec() which iterate several
+ * pixels at once using the SIMD units of the CPU (AVX2 or AVX-512 for double,
+ * AVX-512 IFMA for the integer variant). Every vector lane holds one pixel. If
+ * a lane finishes (either because the point escaped or because maxiterate_ was
+ * reached) it is refilled with the next pixel of the batch, thus long running
+ * lanes do not block the others.
+ * The kernels are selected at runtime according to the instruction set of the
+ * CPU (see kernel.c).
+ *
+ * The results are bit-identical to iterate() because exactly the same
+ * operations are executed in the same order (no FMA contraction) or, in case
+ * of the integer variant, with the same rounding.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include "intfract.h"
+
+#ifdef WITH_SIMD
+#include <immintrin.h>
+
+
+/*! Batch kernel "scalar" which calls iterate() for each pixel. This is the
+ * fallback if the CPU has no suitable SIMD unit.
+ * @param real0 Array of real coordinates of the pixels.
+ * @param imag0 Array of imaginary coordinates of the pixels.
+ * @param cnt Array which receives the number of iterations of each pixel.
+ * @param n Number of pixels in the arrays.
+ */
+void iterate_vec_scalar(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   for (int i = 0; i < n; i++)
+      cnt[i] = iterate(real0[i], imag0[i]);
+}
+
+
+#if defined(USE_DOUBLE) || defined(WITH_IMUL128)
+//! maximum number of lanes
+#define MAX_LANES 8
+
+//! state of the lanes of the batch kernels
+typedef struct vec_lanes
+{
+   //! pixel coordinates, orbit, checkpoint of the orbit and iteration counter
+   nint_t cr[MAX_LANES], ci[MAX_LANES], zr[MAX_LANES], zi[MAX_LANES];
+   nint_t sr[MAX_LANES], si[MAX_LANES], it[MAX_LANES];
+   //! iterations left until the next checkpoint and checkpoint interval
+   nint_t sk[MAX_LANES], sp[MAX_LANES];
+   //! index of the pixel of each lane
+   int idx[MAX_LANES];
+   //! bit mask of the active lanes
+   int active;
+   //! index of the next pixel of the batch
+   int next;
+} __attribute__((aligned(64))) vec_lanes_t;
+
+
+/*! Finish lanes and refill them with the next pixels of the batch. Pixels
+ * within the main cardioid or the period-2 bulb are finished immediately if
+ * the interior checks are enabled. Lanes for which no pixel is left are set
+ * to 0 and become inactive.
+ * @param l Pointer to lane state.
+ * @param lanes Number of lanes.
+ * @param m Bit mask of lanes to finish (if they are active) and refill.
+ * @param cyc Bit mask of lanes which have a periodic orbit.
+ */
+static void vec_refill(vec_lanes_t *l, int lanes, int m, int cyc, const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   for (int k = 0; k < lanes; k++)
+   {
+      if (!(m & (1 << k)))
+         continue;
+
+      if (l->active & (1 << k))
+         cnt[l->idx[k]] = cyc & (1 << k) ? maxiterate_ : l->it[k];
+
+#ifdef WITH_INTERIOR
+      if (interior_)
+         for (; l->next < n && interior(real0[l->next], imag0[l->next]); l->next++)
+            cnt[l->next] = maxiterate_;
+#endif
+
+      if (l->next < n)
+      {
+         l->cr[k] = l->zr[k] = l->sr[k] = real0[l->next];
+         l->ci[k] = l->zi[k] = l->si[k] = imag0[l->next];
+         l->idx[k] = l->next++;
+         l->active |= 1 << k;
+      }
+      else
+      {
+         l->cr[k] = l->ci[k] = l->zr[k] = l->zi[k] = l->sr[k] = l->si[k] = 0;
+         l->active &= ~(1 << k);
+      }
+      l->it[k] = 0;
+      l->sk[k] = l->sp[k] = 1;
+   }
+}
+#endif
+
+
+/* The interior checks of the batch kernels: after each iteration the orbit of
+ * every lane is compared to its checkpoint (Brent's algorithm, see
+ * iterate_periodic()). Each lane counts down to its next checkpoint on its
+ * own, thus the schedule restarts with every pixel which is refilled into a
+ * lane. Pixels within the main cardioid and the period-2 bulb are already
+ * sorted out by vec_refill().
+ */
+
+
+#ifdef USE_DOUBLE
+/*! Iterate a batch of pixels, 4 at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+void iterate_vec_avx2(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   vec_lanes_t l = {.active = 0, .next = 0};
+   __m256d vcr, vci, vzr, vzi, vsr, vsi, vit, vzrq, vziq, done;
+   const __m256d four = _mm256_set1_pd(4.0), one = _mm256_set1_pd(1.0);
+   const __m256d two = _mm256_set1_pd(2.0), max = _mm256_set1_pd(maxiterate_);
+   int m, cyc = 0;
+#ifdef WITH_INTERIOR
+   __m256d vsk, vsp, renew;
+   const __m256d zero = _mm256_setzero_pd();
+   int per = interior_;
+#endif
+
+   vec_refill(&l, 4, 0xf, 0, real0, imag0, cnt, n);
+   if (!l.active)
+      return;
+
+   for (;;)
+   {
+      vcr = _mm256_load_pd(l.cr);
+      vci = _mm256_load_pd(l.ci);
+      vzr = _mm256_load_pd(l.zr);
+      vzi = _mm256_load_pd(l.zi);
+      vsr = _mm256_load_pd(l.sr);
+      vsi = _mm256_load_pd(l.si);
+      vit = _mm256_load_pd(l.it);
+#ifdef WITH_INTERIOR
+      vsk = _mm256_load_pd(l.sk);
+      vsp = _mm256_load_pd(l.sp);
+#endif
+      cyc = 0;
+
+      for (;;)
+      {
+         vzrq = _mm256_mul_pd(vzr, vzr);
+         vziq = _mm256_mul_pd(vzi, vzi);
+
+         // lane is finished if it escaped, reached maxiterate_ or is periodic
+         done = _mm256_or_pd(
+               _mm256_cmp_pd(_mm256_add_pd(vzrq, vziq), four, _CMP_GT_OQ),
+               _mm256_cmp_pd(vit, max, _CMP_GE_OQ));
+
+         if ((m = (_mm256_movemask_pd(done) | cyc) & l.active))
+            break;
+
+         vzi = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(vzr, vzi), two), vci);
+         vzr = _mm256_add_pd(_mm256_sub_pd(vzrq, vziq), vcr);
+         vit = _mm256_add_pd(vit, one);
+
+#ifdef WITH_INTERIOR
+         if (per)
+         {
+            cyc = _mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(vzr, vsr, _CMP_EQ_OQ), _mm256_cmp_pd(vzi, vsi, _CMP_EQ_OQ)));
+            vsk = _mm256_sub_pd(vsk, one);
+            renew = _mm256_cmp_pd(vsk, zero, _CMP_EQ_OQ);
+            vsp = _mm256_blendv_pd(vsp, _mm256_add_pd(vsp, vsp), renew);
+            vsk = _mm256_blendv_pd(vsk, vsp, renew);
+            vsr = _mm256_blendv_pd(vsr, vzr, renew);
+            vsi = _mm256_blendv_pd(vsi, vzi, renew);
+         }
+#endif
+      }
+
+      _mm256_store_pd(l.zr, vzr);
+      _mm256_store_pd(l.zi, vzi);
+      _mm256_store_pd(l.sr, vsr);
+      _mm256_store_pd(l.si, vsi);
+      _mm256_store_pd(l.it, vit);
+#ifdef WITH_INTERIOR
+      _mm256_store_pd(l.sk, vsk);
+      _mm256_store_pd(l.sp, vsp);
+#endif
+
+      vec_refill(&l, 4, m, cyc, real0, imag0, cnt, n);
+      if (!l.active)
+         break;
+   }
+}
+
+
+/*! Iterate a batch of pixels, 8 at a time with AVX-512.
+ */
+__attribute__((target("avx512f")))
+void iterate_vec_avx512(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   vec_lanes_t l = {.active = 0, .next = 0};
+   __m512d vcr, vci, vzr, vzi, vsr, vsi, vit, vzrq, vziq;
+   const __m512d four = _mm512_set1_pd(4.0), one = _mm512_set1_pd(1.0);
+   const __m512d two = _mm512_set1_pd(2.0), max = _mm512_set1_pd(maxiterate_);
+   int m, cyc = 0;
+#ifdef WITH_INTERIOR
+   __m512d vsk, vsp;
+   __mmask8 renew;
+   int per = interior_;
+#endif
+
+   vec_refill(&l, 8, 0xff, 0, real0, imag0, cnt, n);
+   if (!l.active)
+      return;
+
+   for (;;)
+   {
+      vcr = _mm512_load_pd(l.cr);
+      vci = _mm512_load_pd(l.ci);
+      vzr = _mm512_load_pd(l.zr);
+      vzi = _mm512_load_pd(l.zi);
+      vsr = _mm512_load_pd(l.sr);
+      vsi = _mm512_load_pd(l.si);
+      vit = _mm512_load_pd(l.it);
+#ifdef WITH_INTERIOR
+      vsk = _mm512_load_pd(l.sk);
+      vsp = _mm512_load_pd(l.sp);
+#endif
+      cyc = 0;
+
+      for (;;)
+      {
+         vzrq = _mm512_mul_pd(vzr, vzr);
+         vziq = _mm512_mul_pd(vzi, vzi);
+
+         if ((m = (_mm512_cmp_pd_mask(_mm512_add_pd(vzrq, vziq), four, _CMP_GT_OQ)
+               | _mm512_cmp_pd_mask(vit, max, _CMP_GE_OQ) | cyc) & l.active))
+            break;
+
+         vzi = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(vzr, vzi), two), vci);
+         vzr = _mm512_add_pd(_mm512_sub_pd(vzrq, vziq), vcr);
+         vit = _mm512_add_pd(vit, one);
+
+#ifdef WITH_INTERIOR
+         if (per)
+         {
+            cyc = _mm512_cmp_pd_mask(vzr, vsr, _CMP_EQ_OQ) & _mm512_cmp_pd_mask(vzi, vsi, _CMP_EQ_OQ);
+            vsk = _mm512_sub_pd(vsk, one);
+            renew = _mm512_cmp_pd_mask(vsk, _mm512_setzero_pd(), _CMP_EQ_OQ);
+            vsp = _mm512_mask_add_pd(vsp, renew, vsp, vsp);
+            vsk = _mm512_mask_mov_pd(vsk, renew, vsp);
+            vsr = _mm512_mask_mov_pd(vsr, renew, vzr);
+            vsi = _mm512_mask_mov_pd(vsi, renew, vzi);
+         }
+#endif
+      }
+
+      _mm512_store_pd(l.zr, vzr);
+      _mm512_store_pd(l.zi, vzi);
+      _mm512_store_pd(l.sr, vsr);
+      _mm512_store_pd(l.si, vsi);
+      _mm512_store_pd(l.it, vit);
+#ifdef WITH_INTERIOR
+      _mm512_store_pd(l.sk, vsk);
+      _mm512_store_pd(l.sp, vsp);
+#endif
+
+      vec_refill(&l, 8, m, cyc, real0, imag0, cnt, n);
+      if (!l.active)
+         break;
+   }
+}
+#else
+#ifdef WITH_IMUL128
+/*! Fixed point multiplication of two vectors of absolute values a, b < 2^52
+ * with AVX-512 IFMA. The 104 bit product is shifted right by s bits
+ * (s <= 52) and the remainder (the bits shifted out) is returned in rem.
+ */
+#define IFMA_MULSHR(a, b, s, rem) ({ \
+      __m512i _lo = _mm512_madd52lo_epu64(zero, a, b); \
+      __m512i _hi = _mm512_madd52hi_epu64(zero, a, b); \
+      rem = _mm512_and_si512(_lo, _mm512_set1_epi64((1L << (s)) - 1)); \
+      _mm512_or_si512(_mm512_slli_epi64(_hi, 52 - (s)), _mm512_srli_epi64(_lo, s)); })
+
+
+/*! Iterate a batch of pixels, 8 at a time with AVX-512 IFMA.
+ * The integer multiplier of IFMA (vpmadd52luq/vpmadd52huq) calculates
+ * 52x52->104 bit products, which fits the fixed point format with NORM_BITS =
+ * 50 if absolute values are used. A value of 4 * NORM_FACT (= 2^52) or more
+ * escapes anyway, thus such lanes are finished before their product is used.
+ * Signed results are obtained with the same rounding as the arithmetic shift
+ * of sqr128shr() and imul128shr() (i.e. towards negative infinity).
+ */
+__attribute__((target("avx512f,avx512ifma")))
+void iterate_vec_ifma(const nint_t *real0, const nint_t *imag0, int *cnt, int n)
+{
+   vec_lanes_t l = {.active = 0, .next = 0};
+   __m512i vcr, vci, vzr, vzi, vsr, vsi, vit, ar, ai, vzrq, vziq, prod, rem;
+   const __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi64(1);
+   const __m512i lim = _mm512_set1_epi64((1L << 52) - 1), four = _mm512_set1_epi64(4 * NORM_FACT);
+   const __m512i max = _mm512_set1_epi64(maxiterate_);
+   __mmask8 big, neg;
+   int m, cyc = 0;
+#ifdef WITH_INTERIOR
+   __m512i vsk, vsp;
+   __mmask8 renew;
+   int per = interior_;
+#endif
+
+   vec_refill(&l, 8, 0xff, 0, real0, imag0, cnt, n);
+   if (!l.active)
+      return;
+
+   for (;;)
+   {
+      vcr = _mm512_load_si512(l.cr);
+      vci = _mm512_load_si512(l.ci);
+      vzr = _mm512_load_si512(l.zr);
+      vzi = _mm512_load_si512(l.zi);
+      vsr = _mm512_load_si512(l.sr);
+      vsi = _mm512_load_si512(l.si);
+      vit = _mm512_load_si512(l.it);
+#ifdef WITH_INTERIOR
+      vsk = _mm512_load_si512(l.sk);
+      vsp = _mm512_load_si512(l.sp);
+#endif
+      cyc = 0;
+
+      for (;;)
+      {
+         ar = _mm512_abs_epi64(vzr);
+         ai = _mm512_abs_epi64(vzi);
+         big = _mm512_cmpgt_epi64_mask(ar, lim) | _mm512_cmpgt_epi64_mask(ai, lim);
+
+         vzrq = IFMA_MULSHR(ar, ar, NORM_BITS, rem);
+         vziq = IFMA_MULSHR(ai, ai, NORM_BITS, rem);
+
+         if ((m = (big | _mm512_cmpgt_epi64_mask(_mm512_add_epi64(vzrq, vziq), four)
+               | _mm512_cmpge_epi64_mask(vit, max) | cyc) & l.active))
+            break;
+
+         // imag = ((real * imag) >> (NORM_BITS - 1)) + imag0, negative products
+         // are rounded down, i.e. the magnitude is rounded up if bits are lost
+         prod = IFMA_MULSHR(ar, ai, NORM_BITS - 1, rem);
+         neg = _mm512_cmplt_epi64_mask(_mm512_xor_si512(vzr, vzi), zero);
+         prod = _mm512_mask_add_epi64(prod, neg & _mm512_test_epi64_mask(rem, rem), prod, one);
+         prod = _mm512_mask_sub_epi64(prod, neg, zero, prod);
+         vzi = _mm512_add_epi64(prod, vci);
+
+         vzr = _mm512_add_epi64(_mm512_sub_epi64(vzrq, vziq), vcr);
+         vit = _mm512_add_epi64(vit, one);
+
+#ifdef WITH_INTERIOR
+         if (per)
+         {
+            cyc = _mm512_cmpeq_epi64_mask(vzr, vsr) & _mm512_cmpeq_epi64_mask(vzi, vsi);
+            vsk = _mm512_sub_epi64(vsk, one);
+            renew = _mm512_cmpeq_epi64_mask(vsk, zero);
+            vsp = _mm512_mask_slli_epi64(vsp, renew, vsp, 1);
+            vsk = _mm512_mask_mov_epi64(vsk, renew, vsp);
+            vsr = _mm512_mask_mov_epi64(vsr, renew, vzr);
+            vsi = _mm512_mask_mov_epi64(vsi, renew, vzi);
+         }
+#endif
+      }
+
+      _mm512_store_si512(l.zr, vzr);
+      _mm512_store_si512(l.zi, vzi);
+      _mm512_store_si512(l.sr, vsr);
+      _mm512_store_si512(l.si, vsi);
+      _mm512_store_si512(l.it, vit);
+#ifdef WITH_INTERIOR
+      _mm512_store_si512(l.sk, vsk);
+      _mm512_store_si512(l.sp, vsp);
+#endif
+
+      vec_refill(&l, 8, m, cyc, real0, imag0, cnt, n);
+      if (!l.active)
+         break;
+   }
+}
+#endif
+#endif
+
+#endif
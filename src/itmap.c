@@ -0,0 +1,271 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file itmap.c
+ * This file contains the iteration map file format. It stores the raw
+ * iteration counts of an image, thus it can be colored again or cropped
+ * without recalculation. The file is accessed through mmap().
+ *
+ * The file starts with a header (itmap_hdr_t) of hdrsize bytes. It is
+ * followed by the tiles of TILE_SIZE x TILE_SIZE pixels, row by row of tiles
+ * (row 0 is at imagmax, like in mand_calc()). Tiles at the right and bottom
+ * edge are padded to full size, thus every tile is found at a fixed offset and
+ * only the pages of the tiles which are accessed are loaded. Each pixel is a
+ * uint16_t if maxiterate is less than 65536, otherwise a uint32_t. All
+ * numbers are stored in host byte order.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "intfract.h"
+
+
+#define ITMAP_MAGIC "IFRACMAP"
+#define ITMAP_VERSION 1
+//! size of the header on disk, the remaining bytes are 0
+#define ITMAP_HDRSIZE 512
+//! maximum resolution and tile size accepted from a file
+#define ITMAP_MAXRES (1 << 20)
+#define ITMAP_MAXTILE 4096
+
+
+/*! Return the name of the iteration kernel of a view.
+ */
+static const char *itmap_kernel(const fract_view_t *v)
+{
+   if (v->zref != NULL)
+      return "perturb";
+   if (v->limbs)
+      return "mpfix";
+   return kernel_name();
+}
+
+
+/*! Return pointer to pixel (x, y) of the map, row 0 is at imagmax.
+ */
+static inline unsigned char *itmap_pixel(const itmap_t *m, int x, int y)
+{
+   int ts = m->hdr->tile;
+
+   return m->data + (((size_t) (y / ts) * m->ntx + x / ts) * ts * ts + (y % ts) * ts + x % ts) * m->hdr->bpp;
+}
+
+
+/*! Map a file into memory.
+ */
+static itmap_t *itmap_mmap(int fd, size_t size, int prot)
+{
+   itmap_t *m;
+   void *p;
+
+   if ((p = mmap(NULL, size, prot, MAP_SHARED, fd, 0)) == MAP_FAILED)
+   {
+      perror("mmap()");
+      return NULL;
+   }
+
+   if ((m = malloc(sizeof(*m))) == NULL)
+   {
+      perror("malloc()");
+      munmap(p, size);
+      return NULL;
+   }
+
+   m->hdr = p;
+   m->data = (unsigned char*) p + m->hdr->hdrsize;
+   m->size = size;
+   m->ntx = (m->hdr->hres + m->hdr->tile - 1) / m->hdr->tile;
+
+   return m;
+}
+
+
+/*! Create a new iteration map file for a view.
+ * @param s Name of the file.
+ * @param v Pointer to the view.
+ * @param bbox Coordinates as given on the command line.
+ * @param cc 1 if bbox contains center and width/height, see mp_setup().
+ * @return Returns a pointer to the map or NULL in case of error.
+ */
+itmap_t *itmap_create(const char *s, const fract_view_t *v, const char * const *bbox, int cc)
+{
+   itmap_hdr_t hdr;
+   itmap_t *m;
+   size_t size;
+   int fd, ntx, nty;
+
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, ITMAP_MAGIC, sizeof(hdr.magic));
+   hdr.version = ITMAP_VERSION;
+   hdr.hdrsize = ITMAP_HDRSIZE;
+   hdr.hres = v->hres;
+   hdr.vres = v->vres;
+   hdr.tile = TILE_SIZE;
+   hdr.bpp = maxiterate_ < 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+   hdr.maxiterate = maxiterate_;
+   hdr.norm_bits = v->limbs ? MP_FRAC(v->limbs) : NORM_BITS;
+   hdr.cc = cc;
+   snprintf(hdr.kernel, sizeof(hdr.kernel), "%s", itmap_kernel(v));
+   for (int i = 0; i < 4; i++)
+      snprintf(hdr.bbox[i], sizeof(hdr.bbox[i]), "%s", bbox[i]);
+
+   ntx = (v->hres + TILE_SIZE - 1) / TILE_SIZE;
+   nty = (v->vres + TILE_SIZE - 1) / TILE_SIZE;
+   size = ITMAP_HDRSIZE + (size_t) ntx * nty * TILE_SIZE * TILE_SIZE * hdr.bpp;
+
+   if ((fd = open(s, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+   {
+      fprintf(stderr, "failed to open file %s\n", s);
+      return NULL;
+   }
+
+   if (ftruncate(fd, size) == -1 || pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+   {
+      perror("itmap_create()");
+      close(fd);
+      return NULL;
+   }
+
+   m = itmap_mmap(fd, size, PROT_READ | PROT_WRITE);
+   close(fd);
+   return m;
+}
+
+
+/*! Open an existing iteration map file read-only.
+ * @param s Name of the file.
+ * @return Returns a pointer to the map or NULL in case of error.
+ */
+itmap_t *itmap_open(const char *s)
+{
+   itmap_hdr_t hdr;
+   struct stat st;
+   itmap_t *m;
+   int fd;
+
+   if ((fd = open(s, O_RDONLY)) == -1)
+   {
+      fprintf(stderr, "failed to open file %s\n", s);
+      return NULL;
+   }
+
+   if (fstat(fd, &st) == -1)
+   {
+      perror("fstat()");
+      close(fd);
+      return NULL;
+   }
+
+   if (st.st_size < ITMAP_HDRSIZE || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+   {
+      fprintf(stderr, "%s is not an iteration map\n", s);
+      close(fd);
+      return NULL;
+   }
+
+   // the header is checked before its fields are used as divisors and offsets
+   if (memcmp(hdr.magic, ITMAP_MAGIC, sizeof(hdr.magic)) || hdr.version != ITMAP_VERSION ||
+         hdr.hdrsize < sizeof(hdr) || hdr.hdrsize > st.st_size ||
+         hdr.hres < 1 || hdr.hres > ITMAP_MAXRES || hdr.vres < 1 || hdr.vres > ITMAP_MAXRES ||
+         hdr.tile < 1 || hdr.tile > ITMAP_MAXTILE || hdr.maxiterate < 1 || hdr.maxiterate > INT_MAX || (hdr.bpp != sizeof(uint16_t) && hdr.bpp != sizeof(uint32_t)) ||
+         hdr.hdrsize + (size_t) ((hdr.hres + hdr.tile - 1) / hdr.tile) * ((hdr.vres + hdr.tile - 1) / hdr.tile)
+            * hdr.tile * hdr.tile * hdr.bpp > (size_t) st.st_size)
+   {
+      fprintf(stderr, "%s is not a valid iteration map\n", s);
+      close(fd);
+      return NULL;
+   }
+
+   m = itmap_mmap(fd, st.st_size, PROT_READ);
+   close(fd);
+   return m;
+}
+
+
+/*! Unmap and free an iteration map.
+ */
+void itmap_close(itmap_t *m)
+{
+   if (m == NULL)
+      return;
+
+   munmap(m->hdr, m->size);
+   free(m);
+}
+
+
+/*! Store a rectangular section of a view into the map.
+ * @param m Pointer to map.
+ * @param v Pointer to view, the iteration counts are taken from v->image.
+ * @param x0 First column of the section.
+ * @param y0 First row of the section, row 0 is at imagmax.
+ * @param x1 Column following the last column of the section.
+ * @param y1 Row following the last row of the section.
+ */
+void itmap_put(itmap_t *m, const fract_view_t *v, int x0, int y0, int x1, int y1)
+{
+   const int *src;
+   int x, y;
+
+   for (y = y0; y < y1; y++)
+   {
+      src = v->image + v->hres * (v->vres - y - 1);
+      for (x = x0; x < x1; x++)
+         if (m->hdr->bpp == sizeof(uint16_t))
+            *(uint16_t*) itmap_pixel(m, x, y) = src[x];
+         else
+            *(uint32_t*) itmap_pixel(m, x, y) = src[x];
+   }
+}
+
+
+/*! Color a section of the map. The section is given in the orientation of the
+ * output image, i.e. its first row is at imagmin.
+ * @param m Pointer to map.
+ * @param rgb Pointer to the destination.
+ * @param stride Number of pixels per row of the destination.
+ * @param x0 First column of the section.
+ * @param r0 First row of the section.
+ * @param w Width of the section.
+ * @param h Height of the section.
+ */
+void itmap_colorize(const itmap_t *m, uint32_t *rgb, int stride, int x0, int r0, int w, int h)
+{
+   unsigned n;
+   int x, y, r;
+
+   for (r = r0; r < r0 + h; r++, rgb += stride)
+   {
+      y = m->hdr->vres - r - 1;
+      for (x = 0; x < w; x++)
+      {
+         if (m->hdr->bpp == sizeof(uint16_t))
+            n = *(const uint16_t*) itmap_pixel(m, x0 + x, y);
+         else
+            n = *(const uint32_t*) itmap_pixel(m, x0 + x, y);
+         rgb[x] = palette_[n <= m->hdr->maxiterate ? n : m->hdr->maxiterate];
+      }
+   }
+}
@@ -0,0 +1,399 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file kernel.c
+ * This file contains the table of the iteration kernels and their selection
+ * at runtime. There are scalar kernels which calculate a single pixel
+ * (iterate()) and batch kernels which calculate several pixels at once
+ * (iterate_vec()). All kernels of a build share the number format nint_t and
+ * return exactly the same iteration counts, they differ only in speed.
+ *
+ * Kernels which need an instruction set that the CPU does not support are
+ * sorted out with CPUID. Of the remaining ones the fastest scalar and the
+ * fastest batch kernel are chosen by a short calibration run on a fixed set
+ * of points. The choice can be overridden with option -k.
+ *
+ * The packed 32 bit kernels (see iterate32.c) form a second set of kernels
+ * with a lower precision. They are selected in the same way but activated
+ * only for views which do not need more precision (see kernel_narrow()).
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "intfract.h"
+
+
+//! number of calibration points per side
+#define KERNEL_CAL_SIZE 48
+//! maximum number of iterations during calibration
+#define KERNEL_CAL_ITER 1000
+//! number of calibration runs per kernel, the fastest one is taken
+#define KERNEL_CAL_RUNS 3
+
+//! instruction sets required by the kernels
+enum {ISA_NONE, ISA_AVX2, ISA_AVX512F, ISA_IFMA};
+
+typedef struct kernel
+{
+   const char *name;
+   //! instruction set, see kernel_cpu()
+   int isa;
+   //! scalar kernel or NULL
+   int (*iterate)(nint_t, nint_t);
+   //! batch kernel or NULL
+   void (*vec)(const nint_t *, const nint_t *, int *, int);
+   //! 1 for the packed 32 bit kernels
+   int narrow;
+} kernel_t;
+
+
+static const kernel_t kernel_[] =
+{
+#ifdef USE_DOUBLE
+   {"c-double", ISA_NONE, iterate_double, NULL},
+#else
+#ifdef ASM_ITERATE
+   {"asm", ISA_NONE, iterate_asm, NULL},
+   {"asm-stack", ISA_NONE, iterate_asm_stack, NULL},
+#endif
+#ifdef WITH_IMUL128
+   {"c-imul128", ISA_NONE, iterate_imul128, NULL},
+   {"c-int128", ISA_NONE, iterate_int128, NULL},
+#else
+   {"c-long", ISA_NONE, iterate_long, NULL},
+#endif
+#endif
+#ifdef WITH_SIMD
+   {"scalar", ISA_NONE, NULL, iterate_vec_scalar},
+#ifdef USE_DOUBLE
+   {"avx2", ISA_AVX2, NULL, iterate_vec_avx2},
+   {"avx512", ISA_AVX512F, NULL, iterate_vec_avx512},
+#elif defined(WITH_IMUL128)
+   {"ifma", ISA_IFMA, NULL, iterate_vec_ifma},
+#endif
+#endif
+   {"c-int32", ISA_NONE, iterate_int32, NULL, 1},
+#ifdef WITH_SIMD
+   {"avx2-int32", ISA_AVX2, NULL, iterate_vec32_avx2, 1},
+   {"avx512-int32", ISA_AVX512F, NULL, iterate_vec32_avx512, 1},
+#endif
+};
+
+#define NUM_KERNEL (sizeof(kernel_) / sizeof(*kernel_))
+
+
+// the defaults are used until kernel_init() is called
+#if defined(USE_DOUBLE)
+#define KERNEL_DEFAULT iterate_double
+#define KERNEL_DEFAULT_NAME "c-double"
+#elif defined(ASM_ITERATE)
+#define KERNEL_DEFAULT iterate_asm
+#define KERNEL_DEFAULT_NAME "asm"
+#elif defined(WITH_IMUL128)
+#define KERNEL_DEFAULT iterate_imul128
+#define KERNEL_DEFAULT_NAME "c-imul128"
+#else
+#define KERNEL_DEFAULT iterate_long
+#define KERNEL_DEFAULT_NAME "c-long"
+#endif
+
+__thread int (*iterate)(nint_t, nint_t) = KERNEL_DEFAULT;
+#ifdef WITH_SIMD
+__thread void (*iterate_vec)(const nint_t *, const nint_t *, int *, int) = iterate_vec_scalar;
+#endif
+
+//! names of the selected kernels
+static __thread const char *kernel_scalar_ = KERNEL_DEFAULT_NAME;
+#ifdef WITH_SIMD
+static __thread const char *kernel_vec_ = "scalar";
+#endif
+//! selected kernels: scalar, batch, 32 bit scalar, 32 bit batch
+static const kernel_t *kernel_sel_[4];
+//! 1 if the 32 bit kernels are active
+static __thread int kernel_narrow_;
+
+
+/*! Test if the CPU supports the instruction set of a kernel.
+ * @return Returns 1 if supported, otherwise 0.
+ */
+static int kernel_cpu(int isa)
+{
+   switch (isa)
+   {
+      case ISA_AVX2:
+         return __builtin_cpu_supports("avx2");
+      case ISA_AVX512F:
+         return __builtin_cpu_supports("avx512f");
+      case ISA_IFMA:
+         return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+      default:
+         return 1;
+   }
+}
+
+
+/*! Return the kernel of a name.
+ */
+static const kernel_t *kernel_by_name(const char *s, int len)
+{
+   for (unsigned i = 0; i < NUM_KERNEL; i++)
+      if ((int) strlen(kernel_[i].name) == len && !strncmp(s, kernel_[i].name, len))
+         return &kernel_[i];
+   return NULL;
+}
+
+
+/*! Return monotonic time in seconds.
+ */
+static double kernel_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Run a kernel on the calibration points.
+ * @return Returns the time of the fastest run in seconds.
+ */
+static double kernel_run(const kernel_t *k, const nint_t *reals, const nint_t *imags, int *cnt, int n)
+{
+   double t, best = 0;
+
+   for (int r = 0; r < KERNEL_CAL_RUNS; r++)
+   {
+      t = kernel_time();
+      if (k->iterate != NULL)
+         for (int i = 0; i < n; i++)
+            cnt[i] = k->iterate(reals[i], imags[i]);
+#ifdef WITH_SIMD
+      else
+         k->vec(reals, imags, cnt, n);
+#endif
+      t = kernel_time() - t;
+      if (!r || t < best)
+         best = t;
+   }
+   return best;
+}
+
+
+/*! Select the fastest scalar or batch kernel which is supported by the CPU.
+ * @param vec 0 to select a scalar kernel, 1 for a batch kernel.
+ * @param narrow 1 to select a 32 bit kernel. The batch kernel "scalar" is a
+ * candidate of both sets.
+ * @return Returns a pointer to the kernel.
+ */
+static const kernel_t *kernel_calibrate(int vec, int narrow, const nint_t *reals, const nint_t *imags, int *cnt, int n)
+{
+   const kernel_t *k = NULL;
+   double t, best = 0;
+
+   for (unsigned i = 0; i < NUM_KERNEL; i++)
+   {
+      if ((kernel_[i].vec != NULL) != vec || !kernel_cpu(kernel_[i].isa))
+         continue;
+#ifdef WITH_SIMD
+      if (kernel_[i].narrow != narrow && kernel_[i].vec != iterate_vec_scalar)
+#else
+      if (kernel_[i].narrow != narrow)
+#endif
+         continue;
+
+      t = kernel_run(&kernel_[i], reals, imags, cnt, n);
+      if (k == NULL || t < best)
+      {
+         k = &kernel_[i];
+         best = t;
+      }
+   }
+   return k;
+}
+
+
+/*! Select the kernels. Kernels which are not given by name are chosen by
+ * calibration. If a 32 bit scalar kernel is given without a 32 bit batch
+ * kernel, the batch kernel "scalar" is used for the 32 bit set. This function
+ * must be called after maxiterate_ and interior_ are set and before any
+ * thread is started.
+ * @param names Comma separated list of kernel names (at most one scalar and
+ * one batch kernel of each set), or NULL.
+ * @return Returns 0 on success, or -1 if a kernel is unknown or not supported
+ * by the CPU.
+ */
+int kernel_init(const char *names)
+{
+   const kernel_t *k, *sel[4] = {NULL, NULL, NULL, NULL};
+   nint_t *reals, *imags;
+   int *cnt, n, len, maxiter;
+
+   for (const char *s = names; s != NULL && *s; s += len + (s[len] == ','))
+   {
+      len = strcspn(s, ",");
+      if ((k = kernel_by_name(s, len)) == NULL)
+      {
+         fprintf(stderr, "unknown kernel %.*s\n", len, s);
+         return -1;
+      }
+      if (!kernel_cpu(k->isa))
+      {
+         fprintf(stderr, "kernel %s is not supported by this CPU\n", k->name);
+         return -1;
+      }
+      sel[2 * k->narrow + (k->vec != NULL)] = k;
+   }
+#ifdef WITH_SIMD
+   if (sel[2] != NULL && sel[3] == NULL)
+      sel[3] = kernel_by_name("scalar", 6);
+#endif
+
+#ifdef WITH_SIMD
+   if (sel[0] == NULL || sel[1] == NULL || sel[2] == NULL || sel[3] == NULL)
+#else
+   if (sel[0] == NULL || sel[2] == NULL)
+#endif
+   {
+      n = KERNEL_CAL_SIZE * KERNEL_CAL_SIZE;
+      if ((reals = malloc(n * (2 * sizeof(*reals) + sizeof(*cnt)))) == NULL)
+      {
+         perror("malloc()");
+         return -1;
+      }
+      imags = reals + n;
+      cnt = (int*) (imags + n);
+
+      // a section of the seahorse valley with interior and escaping points
+      for (int i = 0; i < n; i++)
+      {
+         reals[i] = (-0.80 + 0.1 * (i % KERNEL_CAL_SIZE) / KERNEL_CAL_SIZE) * NORM_FACT;
+         imags[i] = (0.05 + 0.1 * (i / KERNEL_CAL_SIZE) / KERNEL_CAL_SIZE) * NORM_FACT;
+      }
+
+      maxiter = maxiterate_;
+      if (maxiterate_ > KERNEL_CAL_ITER)
+         maxiterate_ = KERNEL_CAL_ITER;
+
+      for (int j = 0; j < 2; j++)
+      {
+         if (sel[2 * j] == NULL)
+            sel[2 * j] = kernel_calibrate(0, j, reals, imags, cnt, n);
+         // the batch kernel "scalar" depends on the scalar kernel
+         iterate = sel[2 * j]->iterate;
+#ifdef WITH_SIMD
+         if (sel[2 * j + 1] == NULL)
+            sel[2 * j + 1] = kernel_calibrate(1, j, reals, imags, cnt, n);
+#endif
+      }
+
+      maxiterate_ = maxiter;
+      free(reals);
+   }
+
+   memcpy(kernel_sel_, sel, sizeof(kernel_sel_));
+   kernel_narrow(kernel_narrow_);
+
+#ifdef WITH_TIME
+   fprintf(stderr, "kernel: %s, batch kernel: %s, 32 bit kernel: %s, batch kernel: %s\n", sel[0]->name,
+         sel[1] != NULL ? sel[1]->name : "scalar", sel[2]->name, sel[3] != NULL ? sel[3]->name : "scalar");
+#endif
+   return 0;
+}
+
+
+/*! Activate the 32 bit kernels or the kernels of nint_t in the current
+ * thread. This must be called after kernel_init().
+ * @param on 1 to activate the 32 bit kernels, 0 for the nint_t kernels.
+ */
+void kernel_narrow(int on)
+{
+   const kernel_t **sel = kernel_sel_ + 2 * (on != 0);
+
+   kernel_narrow_ = on != 0;
+   if (sel[0] == NULL)
+      return;
+
+   iterate = sel[0]->iterate;
+   kernel_scalar_ = sel[0]->name;
+#ifdef WITH_SIMD
+   iterate_vec = sel[1]->vec;
+   kernel_vec_ = sel[1]->name;
+#endif
+}
+
+
+/*! Return the name of the kernel which calculates the images. This is the
+ * batch kernel unless it is "scalar".
+ */
+const char *kernel_name(void)
+{
+#ifdef WITH_SIMD
+   if (strcmp(kernel_vec_, "scalar"))
+      return kernel_vec_;
+#endif
+   return kernel_scalar_;
+}
+
+
+/*! Write the selected kernels of both sets as a list for kernel_init() to
+ * buf.
+ */
+void kernel_names(char *buf, size_t len)
+{
+   if (kernel_sel_[0] == NULL)
+   {
+      snprintf(buf, len, "%s", kernel_scalar_);
+      return;
+   }
+#ifdef WITH_SIMD
+   snprintf(buf, len, "%s,%s,%s,%s", kernel_sel_[0]->name, kernel_sel_[1]->name, kernel_sel_[2]->name, kernel_sel_[3]->name);
+#else
+   snprintf(buf, len, "%s,%s", kernel_sel_[0]->name, kernel_sel_[2]->name);
+#endif
+}
+
+
+/*! Return a kernel of the table.
+ * @param i Index of the kernel.
+ * @param vec Receives 1 if it is a batch kernel, otherwise 0.
+ * @param narrow Receives 1 if it is a 32 bit kernel, otherwise 0.
+ * @return Returns the name of the kernel if it is supported by the CPU, an
+ * empty string if it is not supported, or NULL if i is beyond the table.
+ */
+const char *kernel_get(int i, int *vec, int *narrow)
+{
+   if (i < 0 || i >= (int) NUM_KERNEL)
+      return NULL;
+
+   *vec = kernel_[i].vec != NULL;
+   *narrow = kernel_[i].narrow;
+   return kernel_cpu(kernel_[i].isa) ? kernel_[i].name : "";
+}
+
+
+/*! Print the names of all kernels of this build.
+ */
+void kernel_list(FILE *f)
+{
+   for (unsigned i = 0; i < NUM_KERNEL; i++)
+      fprintf(f, " %s%s%s%s", kernel_[i].name, kernel_[i].vec != NULL ? " (batch)" : "", kernel_[i].narrow ? " (32 bit)" : "",
+            kernel_cpu(kernel_[i].isa) ? "" : " (unsupported)");
+}
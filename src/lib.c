@@ -0,0 +1,229 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file lib.c
+ * This file contains the C interface of libintfract.a (see libintfract.h).
+ * A render context holds the parameters of the renders, i.e. the iteration
+ * limit and the palette. The images are colored directly into the buffer of
+ * the caller. All renders of all contexts share the thread pool (see pool.c),
+ * thus they may run concurrently in any number of threads.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intfract.h"
+#include "libintfract.h"
+
+
+struct intfract
+{
+   //! render parameters, see param_get()
+   fract_param_t param;
+   int nthreads;
+};
+
+//! asynchronous render
+typedef struct lib_job
+{
+   fract_view_t view;
+   intfract_cb_t cb;
+   void *arg;
+} lib_job_t;
+
+
+/*! Initialize the library. This function must be called once before any
+ * other function of the library.
+ * @param kernels Kernel names as with the option -k, or NULL to choose the
+ * kernels by calibration.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int intfract_init(const char *kernels)
+{
+   return kernel_init(kernels);
+}
+
+
+/*! Create a render context.
+ * @param maxiterate Maximum number of iterations, 0 for the default.
+ * @param colset Color set (see option -c).
+ * @param nthreads Number of threads of each render, 0 for the number of CPUs.
+ * @return Returns a pointer to the context which must be freed with
+ * intfract_free(), or NULL on error.
+ */
+intfract_t *intfract_new(int maxiterate, int colset, int nthreads)
+{
+   fract_param_t save;
+   intfract_t *ctx;
+
+   if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+   {
+      perror("calloc()");
+      return NULL;
+   }
+
+   if (nthreads <= 0 && (nthreads = get_ncpu()) <= 0)
+      nthreads = NUM_THREADS;
+#ifdef WITH_THREADS
+   if (nthreads > MAX_THREADS)
+      nthreads = MAX_THREADS;
+#endif
+   ctx->nthreads = nthreads;
+
+   // the palette is created with the parameters of the context
+   param_get(&save);
+   maxiterate_ = maxiterate > 0 ? maxiterate : MAXITERATE;
+   interior_ = 1;
+   colset_ = colset >= 0 && colset < NUM_COLSET ? colset : 0;
+   formula_ = julia_ = 0;
+   palette_ = palette_create(colset_);
+   param_get(&ctx->param);
+   param_set(&save);
+
+   if (ctx->param.palette == NULL)
+   {
+      free(ctx);
+      return NULL;
+   }
+
+   return ctx;
+}
+
+
+/*! Free a render context. No render of the context may be running.
+ */
+void intfract_free(intfract_t *ctx)
+{
+   if (ctx == NULL)
+      return;
+
+   free(ctx->param.palette);
+   free(ctx);
+}
+
+
+/*! Set up the view of a render. The parameters of the context must be active.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int lib_view(fract_view_t *v, const double *bbox, int w, int h, uint32_t *buf, int stride)
+{
+   char s[4][32];
+   const char *sbbox[4];
+
+   memset(v, 0, sizeof(*v));
+   if (bbox == NULL || buf == NULL || w < 1 || h < 1 || stride < w)
+   {
+      fprintf(stderr, "invalid render parameters\n");
+      return -1;
+   }
+
+   // the precision is chosen from the decimal strings like on the command line
+   for (int i = 0; i < 4; i++)
+   {
+      snprintf(s[i], sizeof(s[i]), "%.17g", bbox[i]);
+      sbbox[i] = s[i];
+   }
+
+   v->hres = w;
+   v->vres = h;
+   v->mode = MODE_FULL;
+   v->rgb = buf;
+   v->stride = stride;
+   return view_setup(v, sbbox, 0, 0, 0);
+}
+
+
+/*! Render an image into a buffer of the caller.
+ * @param ctx Pointer to the render context.
+ * @param bbox Array of realmin, imagmin, realmax, imagmax.
+ * @param w Width of the image in pixels.
+ * @param h Height of the image in pixels.
+ * @param buf Buffer of at least h * stride pixels which receives the colors
+ * as 0x00RRGGBB. Like the PNG of intfract, the first row is at imagmin.
+ * @param stride Number of pixels per row of buf.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int intfract_render(intfract_t *ctx, const double *bbox, int w, int h, uint32_t *buf, int stride)
+{
+   fract_param_t save;
+   fract_view_t v;
+   int ret = -1;
+
+   param_get(&save);
+   param_set(&ctx->param);
+   if (lib_view(&v, bbox, w, h, buf, stride) != -1 && sched_render(&v, 0, h, ctx->nthreads) != -1)
+      ret = 0;
+   perturb_free(&v);
+   param_set(&save);
+
+   return ret;
+}
+
+
+/*! Called by the thread of the pool which finishes an asynchronous render.
+ */
+static void lib_done(void *p, double imbalance)
+{
+   lib_job_t *j = p;
+   intfract_cb_t cb = j->cb;
+   void *arg = j->arg;
+
+   perturb_free(&j->view);
+   free(j);
+   cb(arg, imbalance < 0 ? -1 : 0);
+}
+
+
+/*! Start rendering an image into a buffer of the caller. The function returns
+ * immediately. The parameters are the same as of intfract_render(), buf must
+ * not be accessed until the render is finished.
+ * @param cb Function which is called by a thread of the pool when the image
+ * is finished.
+ * @param arg Argument of cb.
+ * @return Returns 0 on success, or -1 on error. In that case cb is not called.
+ */
+int intfract_render_async(intfract_t *ctx, const double *bbox, int w, int h, uint32_t *buf, int stride, intfract_cb_t cb, void *arg)
+{
+   fract_param_t save;
+   lib_job_t *j;
+   int ret = -1;
+
+   if ((j = malloc(sizeof(*j))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   j->cb = cb;
+   j->arg = arg;
+
+   param_get(&save);
+   param_set(&ctx->param);
+   // the job takes over the parameters which are active now
+   if (lib_view(&j->view, bbox, w, h, buf, stride) != -1 && sched_start(&j->view, ctx->nthreads, lib_done, j) != -1)
+      ret = 0;
+   param_set(&save);
+
+   if (ret == -1)
+   {
+      perturb_free(&j->view);
+      free(j);
+   }
+
+   return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef LIBINTFRACT_H
+#define LIBINTFRACT_H
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file libintfract.h
+ * This file contains the public interface of the library libintfract.a. A
+ * program includes only this file and links with -lintfract -lpng -lcairo
+ * -lm -lpthread.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdint.h>
+
+//! render context, see intfract_new()
+typedef struct intfract intfract_t;
+
+/*! Completion callback of intfract_render_async().
+ * @param arg Argument as passed to intfract_render_async().
+ * @param status 0 on success, -1 on error.
+ */
+typedef void (*intfract_cb_t)(void *arg, int status);
+
+int intfract_init(const char *kernels);
+intfract_t *intfract_new(int maxiterate, int colset, int nthreads);
+void intfract_free(intfract_t *ctx);
+int intfract_render(intfract_t *ctx, const double *bbox, int w, int h, uint32_t *buf, int stride);
+int intfract_render_async(intfract_t *ctx, const double *bbox, int w, int h, uint32_t *buf, int stride, intfract_cb_t cb, void *arg);
+
+#endif
@@ -0,0 +1,461 @@
+/* Copyright 2015-2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file main.c
+ * This file contains the command line interface of intfract. The render
+ * engine itself is built into the library libintfract.a (see lib.c).
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cairo.h>
+#ifdef WITH_TIME
+#include <sys/time.h>
+#endif
+#include "intfract.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+
+
+static int nthreads_ = NUM_THREADS;
+
+
+void usage(const char *s)
+{
+   printf("intfract v2.1 © 2015-2024 Bernhard R. Fischer, <bf@abenteuerland.at>\n"
+         "usage: %s [options] [realmin(x0)] [imagmin(y0)] [realmax(x1)] [imagmax(y1)]\n"
+         "    -A <frames> ...... Render an animation of <frames> frames from the bbox to the bbox of -E.\n"
+         "    -a <samples>[,<threshold>] Anti-aliasing: calculate edge pixels with <samples> sub-samples,\n"
+         "                       edges differ by more than <threshold> iterations (default = %d).\n"
+         "    -b <manifest> .... Render the jobs of a manifest file ('-' = stdin), timings as JSON lines.\n"
+         "    -B <runs> ........ Run the benchmark suite with <runs> runs per view and kernel (JSON).\n"
+         "    -C ............... Coordinates are given as x/y and w/h instead of x0/y0 and x1/y1.\n"
+         "    -c <colset> ...... Choose color set: 0 - %d\n"
+         "    -d ............... Iterate every pixel in multi-precision instead of perturbation.\n"
+         "    -D <dir> ......... Directory of the disk cache of the tile server.\n"
+         "    -E <x0,y0,x1,y1> . End bbox of the animation (interpreted like the bbox, see -C).\n"
+         "    -e <easing> ...... Easing curve of the animation: linear (default), smooth, in, out.\n"
+         "    -f <formula> ..... Formula (default = mandel), see below.\n"
+         "    -g <seconds> ..... Render progressively, write a snapshot after each pass and every <seconds>.\n"
+         "    -h ............... Display this help screen.\n"
+         "    -i <n>|auto ...... Set maximum number of iterations (default = %d), auto chooses it by sampling.\n"
+         "    -J <file> ........ Write the statistics as JSON to <file> instead of stderr (WITH_STATS).\n"
+         "    -j <real,imag> ... Calculate the Julia set of the formula with the constant c.\n"
+         "    -k <kernel>[,<batch kernel>] Iteration kernels (default = fastest by calibration).\n"
+         "    -l <limbs> ....... Precision: 0 = auto (default), 1 = native, 2 - %d = 64 bit limbs,\n"
+         "                       32 = auto with the 32 bit kernels if sufficient.\n"
+         "    -M <tiles> ....... Number of tiles in the memory cache of the tile server (default = %d).\n"
+         "    -m ............... Use Mariani-Silver rectangle subdivision.\n"
+         "    -n <threads> ..... Choose number of threads (default = %d).\n"
+         "    -o <filename> .... Name of output PNG file, \"-\" for stdout.\n"
+         "    -P <workers> ..... Distribute the bands (see -s) to workers: <n> local processes,\n"
+         "                       !<command>, [ip:]port or path, separated by comma.\n"
+         "    -p ............... Disable interior checks (cardioid/bulb and periodicity).\n"
+         "    -R <x,y,w,h> ..... Crop section of the iteration map given with -r.\n"
+         "    -r <mapfile> ..... Color an iteration map instead of calculating the image.\n"
+         "    -S <[ip:]port|path> Run tile server (GET /z/x/y.png) on TCP port or Unix socket.\n"
+         "    -s <rows> ........ Stream the image in bands of <rows> rows (constant memory).\n"
+         "    -t ............... Pin the threads to the CPUs, each one renders a contiguous band (NUMA).\n"
+         "    -W <addr|-> ...... Run as worker (--worker) on [ip:]port, path or stdin/stdout (-).\n"
+         "    -x <width> ....... Choose image width (default = %d).\n"
+         "    -w <mapfile> ..... Save the iteration counts to an iteration map.\n"
+         "    -y <height> ...... Choose image height (default = %d).\n"
+         , s, AA_THRESHOLD, NUM_COLSET - 1, MAXITERATE, MP_MAX_LIMBS, SRV_CACHE, nthreads_, WIDTH, HEIGHT);
+   printf("\n    kernels:");
+   kernel_list(stdout);
+   printf("\n    formulas:");
+   formula_list(stdout);
+   printf("\n");
+   printf("\n    defs: sizeof(nint_t) = %ld, NORM_BITS = %d, NORM_FACT = %ld\n", sizeof(nint_t), NORM_BITS, NORM_FACT);
+#ifdef USE_DOUBLE
+   printf("    USE_DOUBLE is defined\n");
+#endif
+#ifdef ASM_ITERATE
+   printf("    ASM_ITERATE is defined\n");
+#endif
+#ifdef WITH_INTERIOR
+   printf("    WITH_INTERIOR is defined\n");
+#endif
+#ifdef WITH_STATS
+   printf("    WITH_STATS is defined\n");
+#endif
+}
+
+
+int main(int argc, char **argv)
+{
+   double bbox[] = {-2.0, -1.2, 0.7, 1.2};   // realmin, imagmin, realmax, imagmax
+   const char *sbbox[] = {"-2.0", "-1.2", "0.7", "1.2"};   // same as strings
+   int width = WIDTH, height = HEIGHT;       // pixel resolution
+   cairo_surface_t *sfc;                     // colored image
+   uint32_t *rgb;                            // pixels of the surface
+   int n;
+   char *out = "intfract.png";
+   char *wmap = NULL, *rmap = NULL, *crop = NULL, *end = NULL;
+   int frames = 0, ease = EASE_LINEAR, bench = 0;
+   char *srvaddr = NULL, *cachedir = NULL, *kernel = NULL;
+   char *workers = NULL, *worker = NULL, *formula = NULL, *julia = NULL, *batch = NULL;
+   int maxtiles = SRV_CACHE;
+#ifdef WITH_STATS
+   char *statfile = NULL;
+#endif
+   int cc = 0, limbs = 0, direct = 0, band = 0;
+   int aa = 0, aathr = AA_THRESHOLD;
+   double prog = -1;
+   int autoit = 0;
+   fract_view_t view = {.mode = MODE_FULL};
+#ifdef WITH_THREADS
+   nthreads_ = get_ncpu();
+   if (nthreads_ <= 0)
+      nthreads_ = NUM_THREADS;
+   if (nthreads_ > MAX_THREADS)
+      nthreads_ = MAX_THREADS;
+#endif
+
+   // --worker[=addr] is the long form of -W
+   for (int i = 1; i < argc; i++)
+      if (!strcmp(argv[i], "--worker"))
+         argv[i] = "-W-";
+      else if (!strncmp(argv[i], "--worker=", 9))
+      {
+         argv[i] += 7;
+         argv[i][0] = '-';
+         argv[i][1] = 'W';
+      }
+
+   while ((n = getopt(argc, argv, "A:a:B:b:Cc:D:dE:e:f:g:hi:J:j:k:l:M:mn:o:P:pR:r:S:s:tW:w:x:y:")) != -1)
+      switch (n)
+      {
+         case 'd':
+            direct = 1;
+            break;
+
+         case 'D':
+            cachedir = optarg;
+            break;
+
+         case 'E':
+            end = optarg;
+            break;
+
+         case 'e':
+            if ((ease = anim_ease_by_name(optarg)) == -1)
+            {
+               fprintf(stderr, "unknown easing curve %s\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'f':
+            formula = optarg;
+            break;
+
+         case 'g':
+            prog = atof(optarg);
+            if (prog < 0)
+               prog = 0;
+            break;
+
+         case 'h':
+            usage(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'A':
+            frames = atoi(optarg);
+            if (frames < 0)
+               frames = 0;
+            break;
+
+         case 'a':
+            sscanf(optarg, "%d,%d", &aa, &aathr);
+            break;
+
+         case 'B':
+            bench = atoi(optarg);
+            break;
+
+         case 'b':
+            batch = optarg;
+            break;
+
+         case 'C':
+            cc = 1;
+            break;
+
+         case 'c':
+            colset_ = atoi(optarg);
+            if (colset_ < 0 || colset_ >= NUM_COLSET)
+               colset_ = 0;
+            break;
+
+         case 'i':
+            autoit = !strcmp(optarg, "auto");
+            maxiterate_ = atoi(optarg);
+            if (maxiterate_ <= 0)
+               maxiterate_ = MAXITERATE;
+            break;
+
+         case 'J':
+#ifdef WITH_STATS
+            statfile = optarg;
+#else
+            fprintf(stderr, "statistics not available, compile with WITH_STATS\n");
+#endif
+            break;
+
+         case 'j':
+            julia = optarg;
+            break;
+
+         case 'k':
+            kernel = optarg;
+            break;
+
+         case 'l':
+            limbs = atoi(optarg);
+            if (limbs < 0 || (limbs > MP_MAX_LIMBS && limbs != LIMBS_NARROW))
+               limbs = 0;
+            break;
+
+         case 'M':
+            maxtiles = atoi(optarg);
+            if (maxtiles <= 0)
+               maxtiles = SRV_CACHE;
+            break;
+
+         case 'm':
+            view.mode = MODE_MARIANI;
+            break;
+
+         case 'n':
+#ifdef WITH_THREADS
+            int nthreads = atoi(optarg);
+            if (nthreads >= 1)
+               nthreads_ = nthreads <= MAX_THREADS ? nthreads : MAX_THREADS;
+#else
+            fprintf(stderr, "thread support not compiled\n");
+#endif
+            break;
+
+         case 'o':
+            out = optarg;
+            break;
+
+         case 'P':
+            workers = optarg;
+            break;
+
+         case 'p':
+            interior_ = 0;
+            break;
+
+         case 'R':
+            crop = optarg;
+            break;
+
+         case 'r':
+            rmap = optarg;
+            break;
+
+         case 'S':
+            srvaddr = optarg;
+            break;
+
+         case 's':
+            band = atoi(optarg);
+            if (band < 0)
+               band = 0;
+            break;
+
+         case 't':
+            topo_affinity();
+            break;
+
+         case 'W':
+            worker = optarg;
+            break;
+
+         case 'w':
+            wmap = optarg;
+            break;
+
+         case 'x':
+            width = atoi(optarg);
+            if (width <= 0)
+               width = WIDTH;
+            break;
+
+         case 'y':
+            height = atoi(optarg);
+            if (height <= 0)
+               height = HEIGHT;
+            break;
+      }
+
+   if (rmap != NULL)
+      return itmap_recolor(rmap, crop, out) == -1;
+
+   // parse remaining command line arguments
+   for (int i = 0; optind < argc && i < 4; i++, optind++)
+   {
+         bbox[i] = atof(argv[optind]);
+         sbbox[i] = argv[optind];
+   }
+
+   // transform coordinates given as center and width/height
+   if (cc)
+      bbox_center(bbox);
+
+   if (bench)
+      return bench_run(bench, kernel, nthreads_) == -1;
+
+   if (kernel_init(kernel) == -1 || formula_init(formula, julia) == -1)
+      return 1;
+
+   if (worker != NULL)
+      return dist_worker(worker, nthreads_) == -1;
+
+   if (palette_init() == -1)
+      return 1;
+
+   if (srvaddr != NULL)
+      return server_run(srvaddr, bbox, cachedir, maxtiles, nthreads_) == -1;
+
+   if (batch != NULL)
+   {
+      n = batch_run(batch, cc, limbs, direct, view.mode, nthreads_);
+#ifdef WITH_STATS
+      stat_report(statfile);
+#endif
+      return n == -1;
+   }
+
+#ifdef WITH_TIME
+   struct timeval tv0, tv1, tv;
+   gettimeofday(&tv0, NULL);
+#endif
+
+   view.hres = width;
+   view.vres = height;
+
+   // render an animation from bbox to the end bbox
+   if (frames)
+   {
+      double ebbox[4];
+
+      if (end == NULL || sscanf(end, "%lf,%lf,%lf,%lf", &ebbox[0], &ebbox[1], &ebbox[2], &ebbox[3]) != 4)
+      {
+         fprintf(stderr, "animation requires the end bbox (-E)\n");
+         return 1;
+      }
+      if (cc)
+         bbox_center(ebbox);
+
+      n = anim_render(&view, bbox, ebbox, frames, ease, nthreads_, out);
+#ifdef WITH_TIME
+      gettimeofday(&tv1, NULL);
+      timersub(&tv1, &tv0, &tv);
+      fprintf(stderr, "%ld.%06ld\n", tv.tv_sec, tv.tv_usec);
+#endif
+#ifdef WITH_STATS
+      stat_report(statfile);
+#endif
+      return n == -1;
+   }
+   // the limit is chosen before the reference orbit is calculated
+   if (view_setup(&view, sbbox, cc, limbs, direct || autoit) == -1)
+      return 1;
+   if (autoit && (maxiter_auto(&view, direct) == -1 || palette_init() == -1))
+      return 1;
+#ifdef WITH_TIME
+   fprintf(stderr, "precision: %s (%d bits)\n", view.limbs ? "multi-precision" : view.narrow ? "native 32 bit" : "native",
+         view.limbs ? MP_FRAC(view.limbs) : view.narrow ? NORM_BITS32 : NORM_BITS);
+   if (view.zref != NULL)
+      fprintf(stderr, "reference orbit: pixel (%d, %d), %d iterations\n", view.xref, view.yref, view.nref - 1);
+#endif
+
+   if (wmap != NULL && (view.map = itmap_create(wmap, &view, sbbox, cc)) == NULL)
+      return 1;
+
+   // calculate and write the image band by band, or progressively
+   if (band || workers != NULL || prog >= 0)
+   {
+      if (aa)
+         fprintf(stderr, "anti-aliasing is not supported with -s, -P and -g\n");
+      n = workers != NULL ? dist_render(&view, sbbox, cc, direct, workers, band, nthreads_, out) :
+         band ? stream_render(&view, band, nthreads_, out) : prog_render(&view, prog, nthreads_, out);
+      perturb_free(&view);
+      itmap_close(view.map);
+#ifdef WITH_TIME
+      gettimeofday(&tv1, NULL);
+      timersub(&tv1, &tv0, &tv);
+      fprintf(stderr, "%ld.%06ld\n", tv.tv_sec, tv.tv_usec);
+#endif
+#ifdef WITH_STATS
+      stat_report(statfile);
+#endif
+      return n == -1;
+   }
+
+   // the threads color their tiles directly into the surface, its pages are placed by the threads
+   view.stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, width) / sizeof(uint32_t);
+   if ((view.rgb = topo_alloc((size_t) view.stride * height * sizeof(uint32_t))) == NULL)
+      return 1;
+   sfc = cairo_image_surface_create_for_data((unsigned char*) view.rgb, CAIRO_FORMAT_RGB24, width, height, view.stride * sizeof(uint32_t));
+   rgb = view.rgb;
+
+   // anti-aliasing needs the neighbours of each pixel, thus it colors the whole image afterwards
+   if (aa > 1)
+   {
+      if ((view.image = topo_alloc((size_t) width * height * sizeof(*view.image))) == NULL)
+         return 1;
+      view.rgb = NULL;
+      if ((n = sched_render(&view, 0, height, nthreads_)) != -1)
+         n = aa_render(&view, rgb, view.stride, aa, aathr, nthreads_);
+      topo_free(view.image, (size_t) width * height * sizeof(*view.image));
+   }
+   else
+      // call calculation of image
+      n = sched_render(&view, 0, height, nthreads_);
+   perturb_free(&view);
+   itmap_close(view.map);
+
+#ifdef WITH_TIME
+   gettimeofday(&tv1, NULL);
+   timersub(&tv1, &tv0, &tv);
+   fprintf(stderr, "%ld.%06ld\n", tv.tv_sec, tv.tv_usec);
+#endif
+
+   // save image to disk, an incomplete image is not written
+   if (n == -1)
+      fprintf(stderr, "render failed\n");
+   else if (cairo_write_surface(sfc, out) == -1)
+      n = -1;
+   cairo_surface_destroy(sfc);
+   topo_free(rgb, (size_t) view.stride * height * sizeof(uint32_t));
+#ifdef WITH_STATS
+   stat_report(statfile);
+#endif
+
+   free(palette_);
+   return n == -1;
+}
+
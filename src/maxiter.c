@@ -0,0 +1,126 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file maxiter.c
+ * This file contains the automatic selection of the iteration limit
+ * (option -i auto). The first limit is derived from the pixel spacing. Then a
+ * sparse grid of pixels is calculated. As long as raising the limit still
+ * changes a meaningful fraction of the samples, the limit is doubled. Only
+ * the samples which did not escape are calculated again, the escape counts
+ * of all others do not depend on the limit and are kept.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "intfract.h"
+
+
+//! number of samples per side
+#define AUTO_GRID 64
+//! smallest and largest limit
+#define AUTO_MIN 256
+#define AUTO_MAX (1 << 24)
+//! the limit is raised while it changes more than this fraction of the samples
+#define AUTO_CHANGE 0.001
+
+
+/*! Determine the iteration limit of a view and set maxiterate_. The view
+ * must be set up with view_setup() without reference orbit. If perturbation
+ * is used, the reference orbit is calculated for the final limit.
+ * @param v Pointer to the view.
+ * @param direct 1 if every pixel is iterated in multi-precision.
+ * @return Returns the limit, or -1 on error.
+ */
+int maxiter_auto(fract_view_t *v, int direct)
+{
+   int gx = v->hres < AUTO_GRID ? v->hres : AUTO_GRID, gy = v->vres < AUTO_GRID ? v->vres : AUTO_GRID;
+   int sx = v->hres / gx, sy = v->vres / gy, n = gx * gy, lim, open, changed, *cnt;
+   int pt = v->limbs && !direct;
+   double dx, dy, span;
+
+   if ((cnt = malloc(n * sizeof(*cnt))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+
+   // the deeper the zoom the more iterations are needed
+   if (v->limbs)
+   {
+      dx = fabs(mp_to_double(&v->mdreal, v->limbs));
+      dy = fabs(mp_to_double(&v->mdimag, v->limbs));
+   }
+   else
+   {
+      dx = (double) (v->realmax - v->realmin) / NORM_FACT / v->hres;
+      dy = (double) (v->imagmax - v->imagmin) / NORM_FACT / v->vres;
+   }
+   span = (dx < dy ? dx : dy) * (v->hres > v->vres ? v->hres : v->vres);
+   lim = AUTO_MIN * (span > 0 && span < 4 ? 1 + log10(4 / span) : 1);
+
+   maxiterate_ = lim;
+   if (pt && perturb_setup(v) == -1)
+      goto auto_err;
+   for (int j = 0; j < gy; j++)
+      mand_row(v, cnt + j * gx, sy / 2 + j * sy, sx / 2, sx, gx);
+
+   while (lim < AUTO_MAX)
+   {
+      for (int i = open = 0; i < n; i++)
+         open += cnt[i] >= lim;
+      if (!open)
+         break;
+
+      // calculate the samples which did not escape with the doubled limit
+      maxiterate_ = 2 * lim;
+      if (pt)
+      {
+         perturb_free(v);
+         if (perturb_setup(v) == -1)
+            goto auto_err;
+      }
+      for (int i = changed = 0; i < n; i++)
+         if (cnt[i] >= lim)
+         {
+            mand_row(v, &cnt[i], sy / 2 + i / gx * sy, sx / 2 + i % gx * sx, 1, 1);
+            changed += cnt[i] < maxiterate_;
+         }
+#ifdef WITH_TIME
+      fprintf(stderr, "limit %d: %d of %d samples escape\n", maxiterate_, changed, open);
+#endif
+      if (changed <= n * AUTO_CHANGE)
+         break;
+      lim = maxiterate_;
+   }
+
+   maxiterate_ = lim;
+   perturb_free(v);
+   if (pt && perturb_setup(v) == -1)
+      goto auto_err;
+#ifdef WITH_TIME
+   fprintf(stderr, "maximum iterations: %d\n", lim);
+#endif
+   free(cnt);
+   return lim;
+
+auto_err:
+   free(cnt);
+   return -1;
+}
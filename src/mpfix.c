@@ -0,0 +1,521 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file mpfix.c
+ * This file contains a multi-precision fixed point arithmetics for deep zooms
+ * where the resolution of nint_t is not sufficient. It follows the same idea
+ * as the integer variant: a number is an integer of n 64 bit limbs (two's
+ * complement, least significant limb first) which is considered to be
+ * multiplied by 2^MP_FRAC(n). The topmost MP_INT_BITS bits hold the sign and
+ * the integer part. The precision tiers are 128, 192 and 256 bits.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "intfract.h"
+
+
+//! number of guard bits required in addition to the pixel resolution
+#define MP_GUARD_BITS 12
+
+
+/*! Return 1 if a is negative, otherwise 0.
+ */
+static inline int mp_sign(const mpfix_t *a, int n)
+{
+   return a->l[n - 1] >> 63;
+}
+
+
+/*! r = a + b
+ */
+static inline void mp_add(mpfix_t *r, const mpfix_t *a, const mpfix_t *b, int n)
+{
+   unsigned __int128 s = 0;
+
+   for (int i = 0; i < n; i++)
+   {
+      s += (unsigned __int128) a->l[i] + b->l[i];
+      r->l[i] = s;
+      s >>= 64;
+   }
+}
+
+
+/*! r = a - b
+ */
+static inline void mp_sub(mpfix_t *r, const mpfix_t *a, const mpfix_t *b, int n)
+{
+   uint64_t c = 0, t;
+
+   for (int i = 0; i < n; i++)
+   {
+      t = a->l[i] - b->l[i] - c;
+      c = (a->l[i] < b->l[i]) || (a->l[i] == b->l[i] && c);
+      r->l[i] = t;
+   }
+}
+
+
+/*! r = -a
+ */
+static inline void mp_neg(mpfix_t *r, const mpfix_t *a, int n)
+{
+   uint64_t c = 1;
+
+   for (int i = 0; i < n; i++)
+   {
+      r->l[i] = ~a->l[i] + c;
+      c = c && !r->l[i];
+   }
+}
+
+
+/*! Compare a and b.
+ * @return Returns 1 if a > b, otherwise 0.
+ */
+static inline int mp_gt(const mpfix_t *a, const mpfix_t *b, int n)
+{
+   if ((int64_t) a->l[n - 1] != (int64_t) b->l[n - 1])
+      return (int64_t) a->l[n - 1] > (int64_t) b->l[n - 1];
+   for (int i = n - 2; i >= 0; i--)
+      if (a->l[i] != b->l[i])
+         return a->l[i] > b->l[i];
+   return 0;
+}
+
+
+/*! Fixed point multiplication r = (a * b) >> MP_FRAC(n). The magnitude of the
+ * result is truncated.
+ */
+static void mp_mulshr(mpfix_t *r, const mpfix_t *a, const mpfix_t *b, int n)
+{
+   uint64_t p[2 * MP_MAX_LIMBS];
+   mpfix_t ua = {{0}}, ub = {{0}};
+   int neg = mp_sign(a, n) ^ mp_sign(b, n);
+
+   if (mp_sign(a, n))
+      mp_neg(&ua, a, n);
+   else
+      ua = *a;
+   if (mp_sign(b, n))
+      mp_neg(&ub, b, n);
+   else
+      ub = *b;
+
+   mpmul(p, ua.l, ub.l, n);
+
+   // shift by MP_FRAC(n) = 64 * (n - 1) + 64 - MP_INT_BITS bits
+   for (int i = 0; i < n; i++)
+      r->l[i] = (p[i + n - 1] >> (64 - MP_INT_BITS)) | (p[i + n] << MP_INT_BITS);
+
+   if (neg)
+      mp_neg(r, r, n);
+}
+
+
+/*! Multiply the non-negative a by the small integer m.
+ */
+static void mp_mul_small(mpfix_t *r, const mpfix_t *a, unsigned m, int n)
+{
+   unsigned __int128 s = 0;
+
+   for (int i = 0; i < n; i++)
+   {
+      s += (unsigned __int128) a->l[i] * m;
+      r->l[i] = s;
+      s >>= 64;
+   }
+}
+
+
+/*! Divide the non-negative a by the small integer d (truncating).
+ */
+static void mp_div_small(mpfix_t *r, const mpfix_t *a, unsigned d, int n)
+{
+   unsigned __int128 s = 0;
+
+   for (int i = n - 1; i >= 0; i--)
+   {
+      s = (s << 64) | a->l[i];
+      r->l[i] = s / d;
+      s %= d;
+   }
+}
+
+
+/*! Divide signed a by the small integer d.
+ */
+static void mp_sdiv_small(mpfix_t *r, const mpfix_t *a, unsigned d, int n)
+{
+   if (mp_sign(a, n))
+   {
+      mp_neg(r, a, n);
+      mp_div_small(r, r, d, n);
+      mp_neg(r, r, n);
+   }
+   else
+      mp_div_small(r, a, d, n);
+}
+
+
+/*! Convert a multi-precision number to double.
+ */
+double mp_to_double(const mpfix_t *a, int n)
+{
+   mpfix_t u;
+   double d = 0;
+   int i;
+
+   if (mp_sign(a, n))
+   {
+      mp_neg(&u, a, n);
+      return -mp_to_double(&u, n);
+   }
+
+   for (i = n - 1; i >= 0; i--)
+      d = d * 18446744073709551616.0 + a->l[i];
+   return ldexp(d, -MP_FRAC(n));
+}
+
+
+/*! Parse a decimal number (e.g. "-0.743643887037158704752191506114774") into
+ * a multi-precision fixed point number. The decimal fraction is converted
+ * digit by digit from the end (Horner scheme), thus it is exact up to the
+ * resolution of the number format. An exponent ("e-5") is supported as well.
+ * @param a Pointer to the number which receives the result.
+ * @param s Pointer to string.
+ * @param n Number of limbs.
+ */
+void mp_from_str(mpfix_t *a, const char *s, int n)
+{
+   const char *frac, *end;
+   mpfix_t d;
+   int neg = 0, ip = 0, e;
+
+   memset(a, 0, sizeof(*a));
+   memset(&d, 0, sizeof(d));
+
+   while (isspace((unsigned char) *s))
+      s++;
+   if (*s == '-' || *s == '+')
+      neg = *s++ == '-';
+
+   for (; isdigit((unsigned char) *s); s++)
+      ip = ip * 10 + *s - '0';
+
+   frac = end = *s == '.' ? s + 1 : s;
+   while (isdigit((unsigned char) *end))
+      end++;
+   e = *end == 'e' || *end == 'E' ? atoi(end + 1) : 0;
+
+   // fraction: a = (digit + a) / 10 from the last digit to the first one
+   for (s = end - 1; s >= frac; s--)
+   {
+      d.l[n - 1] = (uint64_t) (*s - '0') << (64 - MP_INT_BITS);
+      mp_add(a, a, &d, n);
+      mp_div_small(a, a, 10, n);
+   }
+   d.l[n - 1] = (uint64_t) ip << (64 - MP_INT_BITS);
+   mp_add(a, a, &d, n);
+
+   for (; e < 0; e++)
+      mp_div_small(a, a, 10, n);
+   for (; e > 0; e--)
+      mp_mul_small(a, a, 10, n);
+
+   if (neg)
+      mp_neg(a, a, n);
+}
+
+
+#ifdef WITH_INTERIOR
+/*! This function tests conservatively if a point is within the main cardioid
+ * or the period-2 bulb. It uses double precision with a safety margin, thus
+ * points very close to the border are always iterated.
+ */
+static int mp_interior(const mpfix_t *real0, const mpfix_t *imag0, int n)
+{
+   double x, y, q;
+
+   x = mp_to_double(real0, n);
+   y = mp_to_double(imag0, n);
+
+   if ((x + 1) * (x + 1) + y * y <= 0.0625 - 1e-12)
+      return 1;
+
+   x -= 0.25;
+   q = x * x + y * y;
+   return q * (q + x) <= y * y * 0.25 - 1e-12;
+}
+#endif
+
+
+/*! This function contains the iteration loop using multi-precision fixed
+ * point arithmetics. It is the same algorithm as iterate() including the
+ * interior checks (see WITH_INTERIOR).
+ * @param real0 Real coordinate of pixel within the complex plane.
+ * @param imag0 Imaginary coordinate of the pixel.
+ * @param n Number of limbs.
+ * @return Returns the number of iterations to reach the break condition.
+ */
+int iterate_mp(const mpfix_t *real0, const mpfix_t *imag0, int n)
+{
+   mpfix_t realq, imagq, real, imag, four, t;
+#ifdef WITH_INTERIOR
+   mpfix_t realc, imagc;
+   int k = 1, period = 1;
+
+   if (interior_ && mp_interior(real0, imag0, n))
+      return maxiterate_;
+
+   realc = *real0;
+   imagc = *imag0;
+#endif
+   int i;
+
+   memset(&four, 0, sizeof(four));
+   four.l[n - 1] = (uint64_t) 4 << (64 - MP_INT_BITS);
+
+   real = *real0;
+   imag = *imag0;
+   for (i = 0; i < maxiterate_; i++)
+   {
+      mp_mulshr(&realq, &real, &real, n);
+      mp_mulshr(&imagq, &imag, &imag, n);
+
+      mp_add(&t, &realq, &imagq, n);
+      if (mp_gt(&t, &four, n))
+         break;
+
+      mp_mulshr(&t, &real, &imag, n);
+      mp_add(&t, &t, &t, n);
+      mp_add(&imag, &t, imag0, n);
+
+      mp_sub(&t, &realq, &imagq, n);
+      mp_add(&real, &t, real0, n);
+
+#ifdef WITH_INTERIOR
+      if (interior_)
+      {
+         if (!memcmp(&real, &realc, n * sizeof(uint64_t)) && !memcmp(&imag, &imagc, n * sizeof(uint64_t)))
+            return maxiterate_;
+
+         if (!--k)
+         {
+            k = period <<= 1;
+            realc = real;
+            imagc = imag;
+         }
+      }
+#endif
+   }
+   return i;
+}
+
+
+/*! Return the number of limbs which are required to resolve a pixel spacing.
+ * @param spacing Distance between two pixels in the complex plane.
+ * @return Returns 0 if the native number format (nint_t) is sufficient,
+ * otherwise the number of limbs (2 to MP_MAX_LIMBS).
+ */
+int mp_select(double spacing)
+{
+   int bits, n;
+
+#ifdef USE_DOUBLE
+   // a double resolves 2^-51 at the magnitude of the coordinates (|c| < 4)
+   const int native = 51;
+#else
+   const int native = NORM_BITS;
+#endif
+
+   if (spacing <= 0)
+      return 0;
+
+   bits = ceil(-log2(spacing)) + MP_GUARD_BITS;
+   if (bits <= native)
+      return 0;
+
+   for (n = 2; n < MP_MAX_LIMBS && MP_FRAC(n) < bits; n++);
+   if (MP_FRAC(n) < bits)
+      fprintf(stderr, "warning: pixel spacing %g is beyond the resolution of %d limbs\n", spacing, n);
+
+   return n;
+}
+
+
+/*! Set up the multi-precision coordinates of a view.
+ * @param v Pointer to view. The members hres, vres and limbs must be set.
+ * @param bbox Array of 4 strings with the coordinates realmin, imagmin,
+ * realmax, imagmax (or center and width/height).
+ * @param cc Set to 1 if bbox contains the center and width/height.
+ */
+void mp_setup(fract_view_t *v, const char * const *bbox, int cc)
+{
+   mpfix_t b[4], t;
+   int i, n = v->limbs;
+
+   for (i = 0; i < 4; i++)
+      mp_from_str(&b[i], bbox[i], n);
+
+   // transform coordinates given as center and width/height
+   if (cc)
+   {
+      mp_sdiv_small(&t, &b[2], 2, n);
+      mp_add(&b[2], &b[0], &t, n);
+      mp_sub(&b[0], &b[0], &t, n);
+      mp_sdiv_small(&t, &b[3], 2, n);
+      mp_add(&b[3], &b[1], &t, n);
+      mp_sub(&b[1], &b[1], &t, n);
+   }
+
+   v->mrealmin = b[0];
+   v->mimagmax = b[3];
+   mp_sub(&t, &b[2], &b[0], n);
+   mp_sdiv_small(&v->mdreal, &t, v->hres, n);
+   mp_sub(&t, &b[3], &b[1], n);
+   mp_sdiv_small(&v->mdimag, &t, v->vres, n);
+}
+
+
+/*! Calculate the coordinates of pixel (x, y).
+ */
+static void mp_coords(const fract_view_t *v, int x, int y, mpfix_t *real0, mpfix_t *imag0)
+{
+   mpfix_t t;
+   int n = v->limbs;
+
+   if (mp_sign(&v->mdreal, n))
+   {
+      mp_neg(&t, &v->mdreal, n);
+      mp_mul_small(&t, &t, x, n);
+      mp_sub(real0, &v->mrealmin, &t, n);
+   }
+   else
+   {
+      mp_mul_small(&t, &v->mdreal, x, n);
+      mp_add(real0, &v->mrealmin, &t, n);
+   }
+
+   if (mp_sign(&v->mdimag, n))
+   {
+      mp_neg(&t, &v->mdimag, n);
+      mp_mul_small(&t, &t, y, n);
+      mp_add(imag0, &v->mimagmax, &t, n);
+   }
+   else
+   {
+      mp_mul_small(&t, &v->mdimag, y, n);
+      mp_sub(imag0, &v->mimagmax, &t, n);
+   }
+}
+
+
+/*! Calculate the orbit of pixel (x, y) in multi-precision and store it as
+ * doubles. This is the reference orbit for the perturbation (see perturb.c).
+ * @param v Pointer to view.
+ * @param x Column of the pixel.
+ * @param y Row of the pixel.
+ * @param z Pointer to an array of 2 * (maxiterate_ + 2) doubles which
+ * receives real and imaginary parts of the orbit z_0 = 0, z_1 = c, ...
+ * @return Returns N, which is the index of the first value outside of the
+ * radius (i.e. the iteration count of iterate() + 1), or maxiterate_ + 1.
+ */
+int mp_orbit(const fract_view_t *v, int x, int y, double *z)
+{
+   mpfix_t real0, imag0, realq, imagq, real, imag, four, t;
+   int i, n = v->limbs;
+
+   mp_coords(v, x, y, &real0, &imag0);
+   memset(&four, 0, sizeof(four));
+   four.l[n - 1] = (uint64_t) 4 << (64 - MP_INT_BITS);
+
+   z[0] = z[1] = 0;
+   real = real0;
+   imag = imag0;
+   for (i = 1; i <= maxiterate_; i++)
+   {
+      z[2 * i] = mp_to_double(&real, n);
+      z[2 * i + 1] = mp_to_double(&imag, n);
+
+      mp_mulshr(&realq, &real, &real, n);
+      mp_mulshr(&imagq, &imag, &imag, n);
+
+      mp_add(&t, &realq, &imagq, n);
+      if (mp_gt(&t, &four, n))
+         return i;
+
+      mp_mulshr(&t, &real, &imag, n);
+      mp_add(&t, &t, &t, n);
+      mp_add(&imag, &t, &imag0, n);
+
+      mp_sub(&t, &realq, &imagq, n);
+      mp_add(&real, &t, &real0, n);
+   }
+   z[2 * i] = mp_to_double(&real, n);
+   z[2 * i + 1] = mp_to_double(&imag, n);
+   return i;
+}
+
+
+/*! Calculate a single pixel in multi-precision.
+ * @param v Pointer to view.
+ * @param x Column of the pixel.
+ * @param y Row of the pixel.
+ * @return Returns the number of iterations.
+ */
+int mand_mp_pixel(const fract_view_t *v, int x, int y)
+{
+   mpfix_t real0, imag0;
+
+   mp_coords(v, x, y, &real0, &imag0);
+   return iterate_mp(&real0, &imag0, v->limbs);
+}
+
+
+/*! This is the outer loop like mand_calc() but with multi-precision fixed
+ * point coordinates. The coordinates are calculated incrementally from the
+ * first pixel of the section.
+ * @param v Pointer to view.
+ * @param x0 First column of the section.
+ * @param y0 First row of the section, row 0 is at imagmax.
+ * @param x1 Column following the last column of the section.
+ * @param y1 Row following the last row of the section.
+ */
+void mand_mp(const fract_view_t *v, int x0, int y0, int x1, int y1)
+{
+   mpfix_t real00, real0, imag0;
+   int x, y, n = v->limbs;
+
+   mp_coords(v, x0, y0, &real00, &imag0);
+   for (y = y0; y < y1; y++)
+   {
+      real0 = real00;
+      for (x = x0; x < x1; x++)
+      {
+         *(v->image + x + v->hres * (v->vres - y - 1)) = iterate_mp(&real0, &imag0, n);
+         mp_add(&real0, &real0, &v->mdreal, n);
+      }
+      mp_sub(&imag0, &imag0, &v->mdimag, n);
+   }
+}
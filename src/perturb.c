@@ -0,0 +1,188 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file perturb.c
+ * This file contains the perturbation engine for deep zooms. Only a single
+ * reference orbit Z is calculated in multi-precision (see mpfix.c). All other
+ * pixels iterate just their difference dz to this orbit:
+ *
+ *    dz' = 2 * Z * dz + dz^2 + dc
+ *
+ * The differences are tiny but their relative precision is what matters, thus
+ * they are iterated in double, even in the integer variants (the fixed point
+ * format of nint_t cannot express numbers below 2^-NORM_BITS).
+ *
+ * If the pixel orbit gets closer to 0 than its difference to the reference
+ * (|Z + dz| < |dz|), the precision of dz breaks down and the pixel would glitch.
+ * Also, if the reference escaped early, it cannot be followed any further. In
+ * both cases the pixel is rebased: the reference orbit starts with Z_0 = 0,
+ * thus the current value of the pixel becomes its difference to Z_0 and it
+ * continues from there.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "intfract.h"
+
+
+/*! Test conservatively if c is within the main cardioid or the period-2 bulb.
+ */
+static int pt_interior(double x, double y)
+{
+   double q;
+
+   if ((x + 1) * (x + 1) + y * y <= 0.0625 - 1e-12)
+      return 1;
+
+   x -= 0.25;
+   q = x * x + y * y;
+   return q * (q + x) <= y * y * 0.25 - 1e-12;
+}
+
+
+/*! Iterate a pixel by perturbation of the reference orbit.
+ * @param v Pointer to view containing the reference orbit.
+ * @param dcr Real part of the difference of the pixel to the reference point.
+ * @param dci Imaginary part of the difference.
+ * @return Returns the number of iterations to reach the break condition.
+ */
+static int iterate_pt(const fract_view_t *v, double dcr, double dci)
+{
+   const double *z = v->zref;
+   double dzr = dcr, dzi = dci, zr, zi, zq, tr, ti;
+   int i, m;
+
+   if (interior_ && pt_interior(z[2] + dcr, z[3] + dci))
+      return maxiterate_;
+
+   // z_1 = c, which is Z_1 + dc
+   for (i = 0, m = 1; i < maxiterate_; i++, m++)
+   {
+      zr = z[2 * m] + dzr;
+      zi = z[2 * m + 1] + dzi;
+      zq = zr * zr + zi * zi;
+      if (zq > 4.0)
+         break;
+
+      // rebase to the start of the reference orbit
+      if (m == v->nref || zq < dzr * dzr + dzi * dzi)
+      {
+         dzr = zr;
+         dzi = zi;
+         m = 0;
+      }
+
+      // dz' = dz * (2 * Z + dz) + dc
+      tr = 2 * z[2 * m] + dzr;
+      ti = 2 * z[2 * m + 1] + dzi;
+      zr = dzr * tr - dzi * ti + dcr;
+      dzi = dzr * ti + dzi * tr + dci;
+      dzr = zr;
+   }
+   return i;
+}
+
+
+/*! Calculate the reference orbit of a view. The center of the image is used
+ * as reference point. If its orbit escapes before maxiterate_, some more
+ * candidates are tried and the longest orbit is kept, because it needs less
+ * rebasing.
+ * @param v Pointer to view. The multi-precision coordinates must be set up
+ * (see mp_setup()).
+ * @return Returns 0 on success, or -1 on error.
+ */
+int perturb_setup(fract_view_t *v)
+{
+   double *z;
+   int i, n, x, y;
+
+   if ((v->zref = malloc(2 * (maxiterate_ + 2) * sizeof(*v->zref))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   if ((z = malloc(2 * (maxiterate_ + 2) * sizeof(*z))) == NULL)
+   {
+      perror("malloc()");
+      perturb_free(v);
+      return -1;
+   }
+
+   v->xref = v->hres / 2;
+   v->yref = v->vres / 2;
+   v->nref = mp_orbit(v, v->xref, v->yref, v->zref);
+
+   // candidates on a 3x3 grid
+   for (i = 0; i < 9 && v->nref <= maxiterate_; i++)
+   {
+      x = v->hres * (2 * (i % 3) + 1) / 6;
+      y = v->vres * (2 * (i / 3) + 1) / 6;
+      if ((n = mp_orbit(v, x, y, z)) > v->nref)
+      {
+         double *t = v->zref;
+         v->zref = z;
+         z = t;
+         v->nref = n;
+         v->xref = x;
+         v->yref = y;
+      }
+   }
+   free(z);
+
+   v->ddreal = mp_to_double(&v->mdreal, v->limbs);
+   v->ddimag = mp_to_double(&v->mdimag, v->limbs);
+
+   return 0;
+}
+
+
+/*! Free the reference orbit.
+ */
+void perturb_free(fract_view_t *v)
+{
+   free(v->zref);
+   v->zref = NULL;
+}
+
+
+/*! Calculate a single pixel by perturbation.
+ * @param v Pointer to view.
+ * @param x Column of the pixel.
+ * @param y Row of the pixel.
+ * @return Returns the number of iterations.
+ */
+int mand_pt_pixel(const fract_view_t *v, int x, int y)
+{
+   return iterate_pt(v, (x - v->xref) * v->ddreal, (v->yref - y) * v->ddimag);
+}
+
+
+/*! This is the outer loop like mand_calc() but using perturbation.
+ * @param v Pointer to view.
+ * @param x0 First column of the section.
+ * @param y0 First row of the section, row 0 is at imagmax.
+ * @param x1 Column following the last column of the section.
+ * @param y1 Row following the last row of the section.
+ */
+void mand_pt(const fract_view_t *v, int x0, int y0, int x1, int y1)
+{
+   for (int y = y0; y < y1; y++)
+      for (int x = x0; x < x1; x++)
+         *(v->image + x + v->hres * (v->vres - y - 1)) = mand_pt_pixel(v, x, y);
+}
@@ -0,0 +1,284 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file pool.c
+ * This file contains the thread pool. The threads are created on demand and
+ * persist across renders, thus small renders back to back do not pay the
+ * cost of thread creation. A job consists of a function which is called
+ * once for each index 0 to n - 1. The jobs are kept in a FIFO queue shared
+ * by all renders: a free thread takes the next index of the first job. Each
+ * job carries the render parameters of the thread which submitted it (see
+ * param_get()), thus concurrent renders with different parameters can share
+ * the pool. The threads may be pinned to the CPUs of the process (see
+ * topo.c).
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "intfract.h"
+
+
+typedef struct pool_job
+{
+   //! function which is called for each index
+   void (*func)(void *arg, int idx);
+   void *arg;
+   //! called by the thread which finishes the last index, or NULL
+   void (*done)(void *arg);
+   //! 1 if the submitting thread waits for the job, see pool_run()
+   int sync;
+   //! render parameters of the submitting thread
+   fract_param_t param;
+   //! number of indexes, next index to start, number of indexes finished
+   int n, next, finished;
+   //! next job in the queue
+   struct pool_job *link;
+} pool_job_t;
+
+#ifdef WITH_THREADS
+static pthread_mutex_t pool_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+//! signals new jobs to the threads
+static pthread_cond_t pool_work_ = PTHREAD_COND_INITIALIZER;
+//! signals finished synchronous jobs to the waiting threads
+static pthread_cond_t pool_done_ = PTHREAD_COND_INITIALIZER;
+//! jobs with indexes which are not started yet
+static pool_job_t *pool_head_;
+//! number of threads of the pool
+static int pool_nthreads_;
+#endif
+//! number of the current thread within the pool, -1 if it is no thread of the pool
+static __thread int pool_self_ = -1;
+
+
+/*! Create a job.
+ * @return Returns a pointer to the job, or NULL on error.
+ */
+static pool_job_t *pool_job(void (*func)(void *, int), void *arg, int n, void (*done)(void *), int sync)
+{
+   pool_job_t *job;
+
+   if ((job = calloc(1, sizeof(*job))) == NULL)
+   {
+      perror("calloc()");
+      return NULL;
+   }
+
+   job->func = func;
+   job->arg = arg;
+   job->done = done;
+   job->sync = sync;
+   job->n = n < 1 ? 1 : n;
+   param_get(&job->param);
+   return job;
+}
+
+
+/*! Call the function of a job for one index with the parameters of the job.
+ * Asynchronous jobs are finished and freed by the thread which finishes the
+ * last index.
+ */
+static void pool_exec(pool_job_t *job, int idx)
+{
+   // a synchronous job may be freed by the waiting thread after the unlock
+   int last, sync = job->sync;
+
+   param_set(&job->param);
+   job->func(job->arg, idx);
+
+#ifdef WITH_THREADS
+   pthread_mutex_lock(&pool_mutex_);
+   last = ++job->finished == job->n;
+   if (last && sync)
+      pthread_cond_broadcast(&pool_done_);
+   pthread_mutex_unlock(&pool_mutex_);
+#else
+   last = ++job->finished == job->n;
+#endif
+
+   if (last && !sync)
+   {
+      if (job->done != NULL)
+         job->done(job->arg);
+      free(job);
+   }
+}
+
+
+#ifdef WITH_THREADS
+/*! Take the next index of a job. The job is removed from the queue if it was
+ * its last index. The pool mutex must be locked.
+ * @return Returns the index.
+ */
+static int pool_take(pool_job_t *job)
+{
+   pool_job_t **j;
+   int idx = job->next++;
+
+   if (job->next >= job->n)
+   {
+      for (j = &pool_head_; *j != job; j = &(*j)->link);
+      *j = job->link;
+   }
+
+   return idx;
+}
+
+
+/*! Thread of the pool, it runs the indexes of the jobs in the queue.
+ * @param p Number of the thread within the pool.
+ */
+static void *pool_thread(void *p)
+{
+   pool_job_t *job;
+   int idx;
+
+   pool_self_ = (intptr_t) p;
+   topo_pin(pool_self_);
+   STAT_THREAD(pool_self_ + 1);
+   pthread_mutex_lock(&pool_mutex_);
+   for (;;)
+   {
+      while (pool_head_ == NULL)
+         pthread_cond_wait(&pool_work_, &pool_mutex_);
+
+      job = pool_head_;
+      idx = pool_take(job);
+      pthread_mutex_unlock(&pool_mutex_);
+      pool_exec(job, idx);
+      pthread_mutex_lock(&pool_mutex_);
+   }
+
+   return NULL;
+}
+
+
+/*! Grow the pool to n threads (at most MAX_THREADS) and append a job to the
+ * queue. The job is not queued if the pool has no thread.
+ * @return Returns the number of threads of the pool.
+ */
+static int pool_submit(pool_job_t *job)
+{
+   pthread_t th;
+   int n;
+
+   pthread_mutex_lock(&pool_mutex_);
+   n = job->n < MAX_THREADS ? job->n : MAX_THREADS;
+   for (; pool_nthreads_ < n; pool_nthreads_++)
+   {
+      if (pthread_create(&th, NULL, pool_thread, (void*) (intptr_t) pool_nthreads_))
+      {
+         perror("pthread_create()");
+         break;
+      }
+      pthread_detach(th);
+   }
+
+   if ((n = pool_nthreads_) > 0)
+   {
+      pool_job_t **j;
+      for (j = &pool_head_; *j != NULL; j = &(*j)->link);
+      *j = job;
+      pthread_cond_broadcast(&pool_work_);
+   }
+   pthread_mutex_unlock(&pool_mutex_);
+
+   return n;
+}
+#endif
+
+
+/*! Run a job synchronously. The calling thread takes part in the job, thus
+ * it is finished even if the pool has no free thread, e.g. if it is called
+ * by a thread of the pool.
+ * @param func Function which is called once for each index 0 to n - 1 in
+ * parallel.
+ * @param arg Argument which is passed to func.
+ * @param n Number of indexes, this is usually the number of threads.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int pool_run(void (*func)(void *arg, int idx), void *arg, int n)
+{
+   pool_job_t *job;
+
+   if ((job = pool_job(func, arg, n, NULL, 1)) == NULL)
+      return -1;
+
+#ifdef WITH_THREADS
+   if (pool_submit(job))
+   {
+      pthread_mutex_lock(&pool_mutex_);
+      while (job->next < job->n)
+      {
+         int idx = pool_take(job);
+         pthread_mutex_unlock(&pool_mutex_);
+         pool_exec(job, idx);
+         pthread_mutex_lock(&pool_mutex_);
+      }
+      while (job->finished < job->n)
+         pthread_cond_wait(&pool_done_, &pool_mutex_);
+      pthread_mutex_unlock(&pool_mutex_);
+   }
+   else
+#endif
+      for (int i = 0; i < job->n; i++)
+         pool_exec(job, i);
+
+   free(job);
+   return 0;
+}
+
+
+/*! Start a job asynchronously.
+ * @param func Function which is called once for each index 0 to n - 1 in
+ * parallel.
+ * @param arg Argument which is passed to func and done.
+ * @param n Number of indexes.
+ * @param done Function which is called by the thread which finishes the job,
+ * or NULL.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int pool_start(void (*func)(void *arg, int idx), void *arg, int n, void (*done)(void *arg))
+{
+   pool_job_t *job;
+
+   if ((job = pool_job(func, arg, n, done, 0)) == NULL)
+      return -1;
+
+#ifdef WITH_THREADS
+   // if no thread could be created the job is run by the calling thread
+   if (!pool_submit(job))
+#endif
+      // the job is freed after the last index
+      for (int i = 0, k = job->n; i < k; i++)
+         pool_exec(job, i);
+
+   return 0;
+}
+
+
+/*! Return the number of the calling thread within the pool. The threads are
+ * numbered in the order of their creation, thread i is pinned to CPU i (see
+ * topo_pin()).
+ * @return Returns the number, or -1 if the caller is no thread of the pool.
+ */
+int pool_self(void)
+{
+   return pool_self_;
+}
@@ -0,0 +1,244 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file prog.c
+ * This file contains the progressive rendering. The first pass calculates
+ * every PROG_STEP-th pixel in each direction, every following pass halves the
+ * distance and calculates only the pixels which are new, until the last pass
+ * calculates the remaining pixels at full resolution. Each pixel is
+ * calculated exactly once, thus the total work is the same as of a normal
+ * render. Every sample fills the block of step x step pixels below and right
+ * of it, thus the image is always complete and gets finer with each pass.
+ *
+ * A snapshot is written after each pass and optionally at a fixed interval.
+ * SIGINT cancels the render after the rows which are in progress, the last
+ * snapshot is written.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "intfract.h"
+
+
+//! distance of the pixels of the first pass, it must be a power of 2
+#define PROG_STEP 16
+//! interval in seconds to check for snapshots and the end of a pass
+#define PROG_POLL 0.01
+
+
+typedef struct prog
+{
+   const fract_view_t *view;
+   //! distance of the pixels of this pass
+   int step;
+   //! index of this thread and number of threads
+   int idx, nthreads;
+   //! buffer for the iteration counts of a row
+   int *cnt;
+} prog_t;
+
+//! set by SIGINT
+static volatile sig_atomic_t prog_cancel_;
+//! number of threads which finished the pass
+static int prog_done_;
+
+
+static void prog_sigint(int sig)
+{
+   prog_cancel_ = 1;
+}
+
+
+/*! Return monotonic time in seconds.
+ */
+static double prog_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Thread function, it calculates the new pixels of every nthreads-th row of
+ * the pass.
+ */
+static void prog_thread(void *p, int idx)
+{
+   prog_t *a = (prog_t*) p + idx;
+   const fract_view_t *v = a->view;
+   int s = a->step, x0, step, n, y, w, h;
+   int *row;
+
+   for (y = s * a->idx; y < v->vres && !prog_cancel_; y += s * a->nthreads)
+   {
+      // rows of the previous pass only get the columns in between
+      if (s < PROG_STEP && !(y % (2 * s)))
+      {
+         x0 = s;
+         step = 2 * s;
+      }
+      else
+      {
+         x0 = 0;
+         step = s;
+      }
+      if ((n = (v->hres - x0 + step - 1) / step) <= 0)
+         continue;
+
+      mand_row(v, a->cnt, y, x0, step, n);
+
+      // fill the block of each sample, the rows are stored bottom up
+      h = y + s < v->vres ? s : v->vres - y;
+      for (int j = 0; j < h; j++)
+      {
+         row = v->image + v->hres * (v->vres - y - j - 1);
+         for (int i = 0, x = x0; i < n; i++, x += step)
+         {
+            w = x + s < v->hres ? s : v->hres - x;
+            for (int k = 0; k < w; k++)
+               row[x + k] = a->cnt[i];
+         }
+      }
+   }
+
+   __sync_fetch_and_add(&prog_done_, 1);
+}
+
+
+/*! Write a snapshot of the image. The file is replaced atomically, thus a
+ * viewer always finds a complete image.
+ */
+static void prog_snapshot(const fract_view_t *v, const char *out)
+{
+   char tmp[1024];
+
+   if (!strcmp(out, "-"))
+   {
+      cairo_save_image(v->image, v->hres, v->vres, out);
+      fflush(stdout);
+      return;
+   }
+
+   snprintf(tmp, sizeof(tmp), "%s.tmp", out);
+   cairo_save_image(v->image, v->hres, v->vres, tmp);
+   if (rename(tmp, out) == -1)
+      perror("rename()");
+}
+
+
+/*! Render an image progressively and write a PNG snapshot after each pass.
+ * @param v Pointer to the view, v->image must be NULL.
+ * @param interval Interval in seconds of additional snapshots during a pass,
+ * 0 to write snapshots only at the end of the passes.
+ * @param nthreads Number of threads.
+ * @param out Name of the PNG file, "-" writes all snapshots to stdout.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int prog_render(fract_view_t *v, double interval, int nthreads, const char *out)
+{
+   struct timespec ts = {0, PROG_POLL * 1e9};
+   struct sigaction sa, osa;
+   prog_t *a;
+   double t;
+   int i, ret = -1;
+
+#ifndef WITH_THREADS
+   nthreads = 1;
+#endif
+   if (nthreads < 1)
+      nthreads = 1;
+
+   if ((v->image = malloc(v->hres * v->vres * sizeof(*v->image))) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   if ((a = calloc(nthreads, sizeof(*a))) == NULL)
+   {
+      perror("calloc()");
+      goto prog_exit;
+   }
+   for (i = 0; i < nthreads; i++)
+      if ((a[i].cnt = malloc(v->hres * sizeof(*a[i].cnt))) == NULL)
+      {
+         perror("malloc()");
+         goto prog_free;
+      }
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = prog_sigint;
+   sigaction(SIGINT, &sa, &osa);
+   prog_cancel_ = 0;
+
+   t = prog_time();
+   for (int s = PROG_STEP; s >= 1 && !prog_cancel_; s /= 2)
+   {
+      prog_done_ = 0;
+      for (i = 0; i < nthreads; i++)
+      {
+         a[i].view = v;
+         a[i].step = s;
+         a[i].idx = i;
+         a[i].nthreads = nthreads;
+      }
+      if (pool_start(prog_thread, a, nthreads, NULL) == -1)
+      {
+         sigaction(SIGINT, &osa, NULL);
+         goto prog_free;
+      }
+
+      // the threads are finished when all of them have counted
+      while (__sync_fetch_and_add(&prog_done_, 0) < nthreads)
+      {
+         nanosleep(&ts, NULL);
+         if (interval > 0 && prog_time() - t >= interval)
+         {
+            prog_snapshot(v, out);
+            t = prog_time();
+         }
+      }
+
+      prog_snapshot(v, out);
+      t = prog_time();
+#ifdef WITH_TIME
+      if (!prog_cancel_)
+         fprintf(stderr, "pass %d done\n", s);
+#endif
+   }
+
+   sigaction(SIGINT, &osa, NULL);
+   if (prog_cancel_)
+      fprintf(stderr, "render cancelled\n");
+   else if (v->map != NULL)
+      itmap_put(v->map, v, 0, 0, v->hres, v->vres);
+   ret = 0;
+
+prog_free:
+   for (i = 0; i < nthreads; i++)
+      free(a[i].cnt);
+   free(a);
+prog_exit:
+   free(v->image);
+   v->image = NULL;
+   return ret;
+}
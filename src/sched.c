@@ -0,0 +1,441 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file sched.c
+ * This file contains the tile scheduler. The image is split into tiles of
+ * TILE_SIZE x TILE_SIZE pixels. The cost of each tile is estimated by
+ * iterating its center pixel and the tiles are sorted by cost, thus the
+ * expensive ones are started first. They are dealt round-robin to per-thread
+ * deques. A thread takes the tiles from the front of its own deque. If it runs
+ * empty, it steals tiles from the back of the deques of the other threads.
+ * The threads are taken from the thread pool (see pool.c).
+ *
+ * If the threads are pinned to the CPUs (option -t, see topo.c), each deque
+ * gets a contiguous band of tiles instead, sorted by cost, and thread i of
+ * the pool takes deque i. Thus the pages of the image which a thread writes
+ * first are mostly its own band and they are placed on its NUMA node. Only
+ * the stolen tiles are written by other threads.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "intfract.h"
+
+
+typedef struct tile
+{
+   //! section of the image, see mand_calc()
+   int x0, y0, x1, y1;
+   //! estimated cost
+   int cost;
+} tile_t;
+
+struct sched;
+
+//! deque of tiles of a thread
+typedef struct tqueue
+{
+#ifdef WITH_THREADS
+   pthread_mutex_t mutex;
+#endif
+   //! back pointer to the scheduler
+   struct sched *sched;
+   //! index of this queue
+   int idx;
+   //! 1 if a thread took this queue, see sched_claim()
+   int claimed;
+   //! tiles of this queue
+   tile_t *tile;
+   //! index of the first tile and of the tile following the last one
+   int head, tail;
+   //! number of tiles calculated and number of tiles stolen from others
+   int ntiles, nstolen;
+   //! time in seconds spent in calculating tiles
+   double busy;
+   //! 1 if the calculation of a tile failed
+   int err;
+   //! band of TILE_SIZE rows which receives the raw tiles if they are colored
+   int *buf;
+} tqueue_t;
+
+typedef struct sched
+{
+   //! copy of the view, thus it may be released while the job is running
+   fract_view_t view;
+   tqueue_t *queue;
+   int nqueue;
+   //! all tiles and the queues of the threads
+   tile_t *tile;
+   //! monotonic time of the start
+   double t0;
+   //! 1 if the statistics of the threads are reported
+   int report;
+   //! 1 if the queues hold bands of tiles for pinned threads
+   int band;
+   //! called when an asynchronous render is finished, see sched_start()
+   void (*done)(void *arg, double imbalance);
+   void *arg;
+} sched_t;
+
+
+/*! Return monotonic time in seconds.
+ */
+static double sched_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Sort tiles by decreasing cost.
+ */
+static int tile_cmp(const void *a, const void *b)
+{
+   return ((const tile_t*) b)->cost - ((const tile_t*) a)->cost;
+}
+
+
+/*! Take the next tile from a queue.
+ * @param q Pointer to queue.
+ * @param back Take the tile from the back of the queue if set to 1, otherwise
+ * from the front.
+ * @param t Pointer to tile which receives the tile.
+ * @return Returns 1 if a tile was taken, or 0 if the queue is empty.
+ */
+static int tqueue_take(tqueue_t *q, int back, tile_t *t)
+{
+   int ret = 0;
+
+#ifdef WITH_THREADS
+   pthread_mutex_lock(&q->mutex);
+#endif
+   if (q->head < q->tail)
+   {
+      *t = back ? q->tile[--q->tail] : q->tile[q->head++];
+      ret = 1;
+   }
+#ifdef WITH_THREADS
+   pthread_mutex_unlock(&q->mutex);
+#endif
+
+   return ret;
+}
+
+
+/*! Take a queue which is not taken by another thread yet. With bands of
+ * tiles thread i of the pool takes queue i if it is free.
+ * @param s Pointer to the scheduler.
+ * @param idx Index of the job of the pool.
+ * @return Returns a pointer to the queue.
+ */
+static tqueue_t *sched_claim(sched_t *s, int idx)
+{
+   int i, self;
+
+   if (!s->band)
+      return s->queue + idx;
+
+   // every index of the job takes exactly one queue, thus a free one is found
+   self = pool_self();
+   for (i = self < 0 ? 0 : -1; ; i++)
+   {
+      tqueue_t *q = s->queue + (i < 0 ? self % s->nqueue : i);
+      int taken;
+#ifdef WITH_THREADS
+      pthread_mutex_lock(&q->mutex);
+#endif
+      if (!(taken = q->claimed))
+         q->claimed = 1;
+#ifdef WITH_THREADS
+      pthread_mutex_unlock(&q->mutex);
+#endif
+      if (!taken)
+         return q;
+   }
+}
+
+
+/*! Worker function of the pool, it calculates tiles until all queues are
+ * empty.
+ * @param p Pointer to the scheduler.
+ * @param idx Index of the job, see sched_claim().
+ */
+static void sched_thread(void *p, int idx)
+{
+   tqueue_t *q = sched_claim(p, idx);
+   fract_view_t v = q->sched->view;
+   tile_t t;
+   double t0;
+   int i, err;
+
+   for (;;)
+   {
+      if (!tqueue_take(q, 0, &t))
+      {
+         // steal from the other queues
+         for (i = 1; i < q->sched->nqueue; i++)
+            if (tqueue_take(&q->sched->queue[(q->idx + i) % q->sched->nqueue], 1, &t))
+               break;
+         if (i >= q->sched->nqueue)
+            break;
+         q->nstolen++;
+      }
+
+      t0 = sched_time();
+      // the rows of the tile are rows vres - y1 to vres - y0 - 1 of the image
+      if (v.rgb != NULL)
+         v.image = q->buf - v.hres * (v.vres - t.y1);
+
+      STAT_BEGIN(tc);
+      err = 0;
+      if (v.zref != NULL)
+         mand_pt(&v, t.x0, t.y0, t.x1, t.y1);
+      else if (v.limbs)
+         mand_mp(&v, t.x0, t.y0, t.x1, t.y1);
+      else if (v.mode == MODE_REFINE)
+         err = mand_refine(v.image, v.realmin, v.imagmin, v.realmax, v.imagmax, v.hres, v.vres, t.x0, t.y0, t.x1, t.y1);
+      else if (v.mode == MODE_MARIANI)
+         err = mand_ms(v.image, v.realmin, v.imagmin, v.realmax, v.imagmax, v.hres, v.vres, t.x0, t.y0, t.x1, t.y1);
+      else
+         err = mand_calc(v.image, v.realmin, v.imagmin, v.realmax, v.imagmax, v.hres, v.vres, t.x0, t.y0, t.x1, t.y1);
+      STAT_END(PHASE_COMPUTE, tc);
+
+      // the iteration counts of a failed tile are undefined, thus they are not used
+      if (err == -1)
+      {
+         q->err = 1;
+         continue;
+      }
+
+      if (v.map != NULL)
+         itmap_put(v.map, &v, t.x0, t.y0, t.x1, t.y1);
+      if (v.rgb != NULL)
+         fract_colorize(v.rgb + v.stride * (v.vres - t.y1) + t.x0, v.stride, q->buf + t.x0, v.hres,
+               t.x1 - t.x0, t.y1 - t.y0);
+      q->busy += sched_time() - t0;
+      q->ntiles++;
+   }
+}
+
+
+/*! Free a scheduler.
+ * @return Returns the load imbalance, see sched_render(), or -1 if the
+ * calculation of a tile failed.
+ */
+static double sched_free(sched_t *s)
+{
+   double t0, busy, maxbusy;
+   int i, err = 0;
+
+   t0 = sched_time() - s->t0;
+#ifdef WITH_TIME
+   for (i = 0; s->report && i < s->nqueue; i++)
+      fprintf(stderr, "thread %2d: %4d tiles (%d stolen), busy %.3fs, idle %.3fs (%.1f%%)\n",
+            i, s->queue[i].ntiles, s->queue[i].nstolen, s->queue[i].busy, t0 - s->queue[i].busy,
+            t0 > 0 ? (t0 - s->queue[i].busy) * 100 / t0 : 0);
+#endif
+
+   for (i = 0, busy = maxbusy = 0; i < s->nqueue; i++)
+   {
+      err |= s->queue[i].err;
+      busy += s->queue[i].busy;
+      if (s->queue[i].busy > maxbusy)
+         maxbusy = s->queue[i].busy;
+      free(s->queue[i].buf);
+#ifdef WITH_THREADS
+      pthread_mutex_destroy(&s->queue[i].mutex);
+#endif
+   }
+   free(s->queue);
+   free(s->tile);
+   free(s);
+
+   if (err)
+      return -1;
+   return busy > 0 ? maxbusy * i / busy - 1 : 0;
+}
+
+
+/*! Split a horizontal band of the image into tiles and deal them to the
+ * queues of the threads.
+ * @return Returns a pointer to the scheduler, or NULL on error.
+ */
+static sched_t *sched_create(const fract_view_t *v, int y0, int y1, int nthreads)
+{
+   tile_t *tile;
+   sched_t *s;
+   int i, n, x, y, ntiles, qsize;
+
+#ifndef WITH_THREADS
+   nthreads = 1;
+#endif
+   if (nthreads < 1)
+      nthreads = 1;
+
+   ntiles = ((v->hres + TILE_SIZE - 1) / TILE_SIZE) * ((y1 - y0 + TILE_SIZE - 1) / TILE_SIZE);
+   qsize = (ntiles + nthreads - 1) / nthreads;
+   if ((tile = malloc((ntiles + nthreads * qsize) * sizeof(*tile))) == NULL)
+   {
+      perror("malloc()");
+      return NULL;
+   }
+
+   // split image into tiles and estimate their cost
+   for (n = 0, y = y0; y < y1; y += TILE_SIZE)
+      for (x = 0; x < v->hres; x += TILE_SIZE, n++)
+      {
+         tile[n].x0 = x;
+         tile[n].y0 = y;
+         tile[n].x1 = x + TILE_SIZE < v->hres ? x + TILE_SIZE : v->hres;
+         tile[n].y1 = y + TILE_SIZE < y1 ? y + TILE_SIZE : y1;
+         tile[n].cost = v->zref != NULL ? mand_pt_pixel(v, (tile[n].x0 + tile[n].x1) / 2, (tile[n].y0 + tile[n].y1) / 2) :
+            v->limbs ? mand_mp_pixel(v, (tile[n].x0 + tile[n].x1) / 2, (tile[n].y0 + tile[n].y1) / 2) :
+            mand_pixel(v->realmin, v->imagmin, v->realmax, v->imagmax, v->hres, v->vres,
+               (tile[n].x0 + tile[n].x1) / 2, (tile[n].y0 + tile[n].y1) / 2);
+      }
+
+   if ((s = calloc(1, sizeof(*s))) == NULL || (s->queue = calloc(nthreads, sizeof(*s->queue))) == NULL)
+   {
+      perror("calloc()");
+      free(s);
+      free(tile);
+      return NULL;
+   }
+   s->view = *v;
+   s->nqueue = nthreads;
+   s->tile = tile;
+   // report only for the full image, not for every band
+   s->report = y0 == 0 && y1 == v->vres;
+
+   // each thread needs a buffer for the raw tiles if they are colored
+   for (i = 0; v->rgb != NULL && i < nthreads; i++)
+      if ((s->queue[i].buf = malloc(v->hres * TILE_SIZE * sizeof(*s->queue[i].buf))) == NULL)
+      {
+         perror("malloc()");
+         while (i--)
+            free(s->queue[i].buf);
+         free(s->queue);
+         free(s);
+         free(tile);
+         return NULL;
+      }
+
+   // set up the queues
+   for (i = 0; i < nthreads; i++)
+   {
+      s->queue[i].sched = s;
+      s->queue[i].idx = i;
+      s->queue[i].tile = tile + ntiles + qsize * i;
+#ifdef WITH_THREADS
+      pthread_mutex_init(&s->queue[i].mutex, NULL);
+#endif
+   }
+   if ((s->band = topo_pinned()))
+   {
+      // deal contiguous bands of tiles, the expensive ones of each band first
+      for (n = 0; n < ntiles; n++)
+      {
+         tqueue_t *q = &s->queue[(long) n * nthreads / ntiles];
+         q->tile[q->tail++] = tile[n];
+      }
+      for (i = 0; i < nthreads; i++)
+         qsort(s->queue[i].tile, s->queue[i].tail, sizeof(*tile), tile_cmp);
+   }
+   else
+   {
+      // deal the tiles round-robin by decreasing cost
+      qsort(tile, ntiles, sizeof(*tile), tile_cmp);
+      for (n = 0; n < ntiles; n++)
+         s->queue[n % nthreads].tile[s->queue[n % nthreads].tail++] = tile[n];
+   }
+
+   s->t0 = sched_time();
+   return s;
+}
+
+
+/*! Calculate the image or a horizontal band of it using the tile scheduler.
+ * @param v Pointer to the view to calculate.
+ * @param y0 First row of the band, row 0 is at imagmax.
+ * @param y1 Row following the last row of the band.
+ * @param nthreads Number of threads to use.
+ * @return Returns the load imbalance, i.e. the busy time of the busiest thread
+ * relative to the average busy time minus 1 (0 means perfect balance), or -1
+ * in case of error.
+ */
+double sched_render(const fract_view_t *v, int y0, int y1, int nthreads)
+{
+   sched_t *s;
+
+   if ((s = sched_create(v, y0, y1, nthreads)) == NULL)
+      return -1;
+
+   if (pool_run(sched_thread, s, s->nqueue) == -1)
+   {
+      sched_free(s);
+      return -1;
+   }
+
+   return sched_free(s);
+}
+
+
+/*! Called by the thread which finishes an asynchronous render.
+ */
+static void sched_done(void *p)
+{
+   sched_t *s = p;
+   void (*done)(void *, double) = s->done;
+   void *arg = s->arg;
+
+   done(arg, sched_free(s));
+}
+
+
+/*! Calculate the image asynchronously. The function returns immediately.
+ * @param v Pointer to the view to calculate, it is copied.
+ * @param nthreads Number of threads to use.
+ * @param done Function which is called by the thread of the pool which
+ * finishes the image. It receives arg and the load imbalance, or -1 in case
+ * of error (see sched_render()).
+ * @param arg Argument of done.
+ * @return Returns 0 on success, or -1 on error. In that case done is not
+ * called.
+ */
+int sched_start(const fract_view_t *v, int nthreads, void (*done)(void *arg, double imbalance), void *arg)
+{
+   sched_t *s;
+
+   if ((s = sched_create(v, 0, v->vres, nthreads)) == NULL)
+      return -1;
+
+   s->report = 0;
+   s->done = done;
+   s->arg = arg;
+   if (pool_start(sched_thread, s, s->nqueue, sched_done) == -1)
+   {
+      sched_free(s);
+      return -1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,876 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file server.c
+ * This file contains a tile server for map viewers. It answers HTTP requests
+ * of the form "GET /z/x/y.png[?c=colset]" with PNG tiles of SRV_TILE x
+ * SRV_TILE pixels. The bbox given on the command line is the whole map at
+ * zoom level 0, every zoom level doubles the number of tiles in both
+ * directions. Tile row 0 is at imagmin, which is the orientation of the
+ * images written by intfract, thus the tiles put together are the same image.
+ *
+ * The connections are handled by a fixed number of worker threads, thus a
+ * burst of requests does not start more calculations than there are CPUs.
+ * Accepted connections wait in a queue, further ones in the listen backlog.
+ * The iteration counts and the encoded PNGs of the tiles are kept in an LRU
+ * cache. Concurrent requests for the same tile wait for the thread which
+ * calculates it. After a tile was requested its neighbours are prefetched by
+ * idle workers. Optionally, the PNGs are stored in a directory, which is a
+ * second level cache that survives restarts. It is keyed by a hash of the
+ * render parameters.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <png.h>
+
+#include "intfract.h"
+
+/*! Create a listening or a connected socket. Addresses containing a '/' are
+ * Unix domain sockets, otherwise it is "[ip:]port" (the default ip is
+ * 127.0.0.1).
+ * @param addr Address.
+ * @param server 1 to listen on the address, 0 to connect to it.
+ * @return Returns the file descriptor of the socket or -1 on error.
+ */
+int srv_socket(const char *addr, int server)
+{
+   struct sockaddr_un su;
+   struct sockaddr_in si;
+   const char *p;
+   char ip[64] = "127.0.0.1";
+   int fd = -1, on = 1;
+
+   if (strchr(addr, '/') != NULL)
+   {
+      memset(&su, 0, sizeof(su));
+      su.sun_family = AF_UNIX;
+      snprintf(su.sun_path, sizeof(su.sun_path), "%s", addr);
+      if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+         goto srv_socket_err;
+      if (!server)
+      {
+         if (connect(fd, (struct sockaddr*) &su, sizeof(su)) == -1)
+            goto srv_socket_err;
+         return fd;
+      }
+      unlink(addr);
+      if (bind(fd, (struct sockaddr*) &su, sizeof(su)) == -1)
+         goto srv_socket_err;
+   }
+   else
+   {
+      memset(&si, 0, sizeof(si));
+      si.sin_family = AF_INET;
+      if ((p = strrchr(addr, ':')) != NULL)
+      {
+         snprintf(ip, sizeof(ip), "%.*s", (int) (p - addr), addr);
+         addr = p + 1;
+      }
+      si.sin_port = htons(atoi(addr));
+      if (inet_pton(AF_INET, ip, &si.sin_addr) != 1)
+      {
+         fprintf(stderr, "illegal address %s\n", ip);
+         return -1;
+      }
+      if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+         goto srv_socket_err;
+      if (!server)
+      {
+         if (connect(fd, (struct sockaddr*) &si, sizeof(si)) == -1)
+            goto srv_socket_err;
+         return fd;
+      }
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind(fd, (struct sockaddr*) &si, sizeof(si)) == -1)
+         goto srv_socket_err;
+   }
+
+   if (listen(fd, 64) == -1)
+      goto srv_socket_err;
+
+   return fd;
+
+srv_socket_err:
+   perror("srv_socket()");
+   if (fd != -1)
+      close(fd);
+   return -1;
+}
+
+
+#ifdef WITH_THREADS
+
+//! width and height of a tile in pixels
+#define SRV_TILE 256
+//! maximum zoom level
+#define SRV_MAXZOOM 30
+//! length of the prefetch queue
+#define SRV_PREFETCH 64
+//! length of the queue of accepted connections
+#define SRV_CONNQ 64
+//! timeout in seconds of reading and writing a connection
+#define SRV_TIMEOUT 10
+
+
+//! encoded PNG
+typedef struct srv_png
+{
+   unsigned char *buf;
+   size_t len, size;
+} srv_png_t;
+
+typedef struct srv_tile
+{
+   int z, x, y;
+   //! iteration counts, NULL if the calculation failed
+   int *image;
+   //! PNGs of the color sets, they are encoded on demand
+   srv_png_t png[NUM_COLSET];
+   //! 1 if the iteration counts are calculated
+   int ready;
+   //! number of threads using this tile, it is not evicted if it is in use
+   int refcnt;
+   //! LRU list, most recently used first
+   struct srv_tile *prev, *next;
+   //! next tile in hash chain
+   struct srv_tile *hnext;
+} srv_tile_t;
+
+typedef struct server
+{
+   pthread_mutex_t mutex;
+   //! signaled if a tile gets ready
+   pthread_cond_t cond;
+   srv_tile_t **hash;
+   int hsize;
+   srv_tile_t *head, *tail;
+   int ntiles, maxtiles;
+   //! directory of the disk cache of the render parameters or NULL
+   char *dir;
+   //! bbox of zoom level 0
+   double bbox[4];
+   uint32_t *palette[NUM_COLSET];
+   //! render parameters of the threads, see param_get()
+   fract_param_t param;
+   //! signals connections and prefetch requests to the workers
+   pthread_cond_t pcond;
+   //! prefetch queue (z, x, y)
+   int pq[SRV_PREFETCH][3];
+   int phead, ptail;
+   //! signaled if a connection is taken from the queue
+   pthread_cond_t ccond;
+   //! queue of accepted connections
+   int cq[SRV_CONNQ];
+   int chead, ctail;
+} server_t;
+
+
+static unsigned srv_hash(const server_t *s, int z, int x, int y)
+{
+   return ((unsigned) z * 73856093u ^ (unsigned) x * 19349663u ^ (unsigned) y * 83492791u) % s->hsize;
+}
+
+
+/*! Remove a tile from the LRU list.
+ */
+static void srv_unlink(server_t *s, srv_tile_t *t)
+{
+   if (t->prev != NULL)
+      t->prev->next = t->next;
+   else
+      s->head = t->next;
+   if (t->next != NULL)
+      t->next->prev = t->prev;
+   else
+      s->tail = t->prev;
+   t->prev = t->next = NULL;
+}
+
+
+/*! Insert a tile at the front of the LRU list.
+ */
+static void srv_push(server_t *s, srv_tile_t *t)
+{
+   t->prev = NULL;
+   t->next = s->head;
+   if (s->head != NULL)
+      s->head->prev = t;
+   else
+      s->tail = t;
+   s->head = t;
+}
+
+
+/*! Find a tile in the cache. The mutex must be locked.
+ */
+static srv_tile_t *srv_find(server_t *s, int z, int x, int y)
+{
+   srv_tile_t *t;
+
+   for (t = s->hash[srv_hash(s, z, x, y)]; t != NULL; t = t->hnext)
+      if (t->z == z && t->x == x && t->y == y)
+         return t;
+   return NULL;
+}
+
+
+/*! Remove a tile from the cache. The mutex must be locked.
+ */
+static void srv_remove(server_t *s, srv_tile_t *t)
+{
+   srv_tile_t **h;
+
+   srv_unlink(s, t);
+   for (h = &s->hash[srv_hash(s, t->z, t->x, t->y)]; *h != t; h = &(*h)->hnext);
+   *h = t->hnext;
+   s->ntiles--;
+}
+
+
+/*! Free a tile.
+ */
+static void srv_free(srv_tile_t *t)
+{
+   for (int i = 0; i < NUM_COLSET; i++)
+      free(t->png[i].buf);
+   free(t->image);
+   free(t);
+}
+
+
+/*! Evict least recently used tiles which are not in use until the cache is
+ * within its size. The mutex must be locked.
+ */
+static void srv_evict(server_t *s)
+{
+   srv_tile_t *t, *prev;
+
+   for (t = s->tail; t != NULL && s->ntiles > s->maxtiles; t = prev)
+   {
+      prev = t->prev;
+      if (t->refcnt || !t->ready)
+         continue;
+
+      srv_remove(s, t);
+      srv_free(t);
+   }
+}
+
+
+/*! Calculate the iteration counts of a tile.
+ */
+static int *srv_calc(const server_t *s, int z, int x, int y)
+{
+   double n = 1 << z, w = s->bbox[2] - s->bbox[0], h = s->bbox[3] - s->bbox[1];
+   int *image;
+
+   if ((image = malloc(SRV_TILE * SRV_TILE * sizeof(*image))) == NULL)
+   {
+      perror("malloc()");
+      return NULL;
+   }
+
+   if (mand_calc(image,
+         (s->bbox[0] + w * x / n) * NORM_FACT, (s->bbox[1] + h * y / n) * NORM_FACT,
+         (s->bbox[0] + w * (x + 1) / n) * NORM_FACT, (s->bbox[1] + h * (y + 1) / n) * NORM_FACT,
+         SRV_TILE, SRV_TILE, 0, 0, SRV_TILE, SRV_TILE) == -1)
+   {
+      free(image);
+      return NULL;
+   }
+
+   return image;
+}
+
+
+/*! Get a tile from the cache. If it is currently calculated by another
+ * thread, this function waits for it. A tile whose calculation failed is
+ * removed from the cache immediately, thus it is calculated again by the
+ * next request. It is freed by the last thread which waited for it.
+ * @param calc 1 to calculate the tile if it is not cached, 0 to return NULL
+ * in that case.
+ * @return Returns a pointer to the tile or NULL if it is not cached or the
+ * calculation failed. It must be released with srv_put().
+ */
+static srv_tile_t *srv_get(server_t *s, int z, int x, int y, int calc)
+{
+   srv_tile_t *t;
+   unsigned h;
+
+   pthread_mutex_lock(&s->mutex);
+   if ((t = srv_find(s, z, x, y)) != NULL)
+   {
+      t->refcnt++;
+      srv_unlink(s, t);
+      srv_push(s, t);
+      while (!t->ready)
+         pthread_cond_wait(&s->cond, &s->mutex);
+      if (t->image == NULL)
+      {
+         if (!--t->refcnt)
+            srv_free(t);
+         t = NULL;
+      }
+      pthread_mutex_unlock(&s->mutex);
+      return t;
+   }
+
+   if (!calc)
+   {
+      pthread_mutex_unlock(&s->mutex);
+      return NULL;
+   }
+
+   if ((t = calloc(1, sizeof(*t))) == NULL)
+   {
+      perror("calloc()");
+      pthread_mutex_unlock(&s->mutex);
+      return NULL;
+   }
+   t->z = z;
+   t->x = x;
+   t->y = y;
+   t->refcnt = 1;
+   h = srv_hash(s, z, x, y);
+   t->hnext = s->hash[h];
+   s->hash[h] = t;
+   srv_push(s, t);
+   s->ntiles++;
+   srv_evict(s);
+   pthread_mutex_unlock(&s->mutex);
+
+   t->image = srv_calc(s, z, x, y);
+
+   pthread_mutex_lock(&s->mutex);
+   t->ready = 1;
+   if (t->image == NULL)
+   {
+      srv_remove(s, t);
+      if (!--t->refcnt)
+         srv_free(t);
+      t = NULL;
+   }
+   pthread_cond_broadcast(&s->cond);
+   pthread_mutex_unlock(&s->mutex);
+
+   return t;
+}
+
+
+/*! Release a tile.
+ */
+static void srv_put(server_t *s, srv_tile_t *t)
+{
+   pthread_mutex_lock(&s->mutex);
+   t->refcnt--;
+   srv_evict(s);
+   pthread_mutex_unlock(&s->mutex);
+}
+
+
+static void srv_png_write(png_structp png, png_bytep data, png_size_t len)
+{
+   srv_png_t *p = png_get_io_ptr(png);
+   unsigned char *buf;
+
+   if (p->len + len > p->size)
+   {
+      p->size = (p->len + len) * 2;
+      if ((buf = realloc(p->buf, p->size)) == NULL)
+         png_error(png, "out of memory");
+      p->buf = buf;
+   }
+   memcpy(p->buf + p->len, data, len);
+   p->len += len;
+}
+
+
+static void srv_png_flush(png_structp png)
+{
+}
+
+
+/*! Encode iteration counts as PNG.
+ * @param p Pointer to the PNG buffer which receives the result.
+ * @param image Iteration counts.
+ * @param pal Palette.
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int srv_encode(srv_png_t *p, const int *image, const uint32_t *pal)
+{
+   png_structp png;
+   png_infop info;
+   unsigned char row[SRV_TILE * 3];
+
+   memset(p, 0, sizeof(*p));
+   if ((png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL)) == NULL)
+      return -1;
+   if ((info = png_create_info_struct(png)) == NULL || setjmp(png_jmpbuf(png)))
+   {
+      png_destroy_write_struct(&png, &info);
+      free(p->buf);
+      p->buf = NULL;
+      return -1;
+   }
+
+   png_set_write_fn(png, p, srv_png_write, srv_png_flush);
+   png_set_IHDR(png, info, SRV_TILE, SRV_TILE, 8, PNG_COLOR_TYPE_RGB,
+         PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+   png_write_info(png, info);
+   for (int y = 0; y < SRV_TILE; y++)
+   {
+      for (int x = 0; x < SRV_TILE; x++, image++)
+      {
+         row[3 * x] = pal[*image] >> 16;
+         row[3 * x + 1] = pal[*image] >> 8;
+         row[3 * x + 2] = pal[*image];
+      }
+      png_write_row(png, row);
+   }
+   png_write_end(png, NULL);
+   png_destroy_write_struct(&png, &info);
+
+   return 0;
+}
+
+
+/*! Return a hash (FNV-1a) of the render parameters which change the tiles.
+ * It is part of the path of the disk cache, thus tiles of different
+ * parameters never mix.
+ */
+static unsigned srv_key(const server_t *s)
+{
+   struct
+   {
+      double bbox[4];
+      int maxiterate, interior, formula, julia, bits, size;
+      nint_t julia_real, julia_imag;
+   } k;
+   const unsigned char *b = (const unsigned char*) &k;
+   unsigned h = 2166136261u;
+
+   // the padding is hashed too
+   memset(&k, 0, sizeof(k));
+   memcpy(k.bbox, s->bbox, sizeof(k.bbox));
+   k.maxiterate = s->param.maxiterate;
+   k.interior = s->param.interior;
+   k.formula = s->param.formula;
+   k.julia = s->param.julia;
+   k.julia_real = s->param.julia_real;
+   k.julia_imag = s->param.julia_imag;
+   k.bits = NORM_BITS;
+   k.size = sizeof(nint_t);
+
+   for (size_t i = 0; i < sizeof(k); i++)
+      h = (h ^ b[i]) * 16777619u;
+   return h;
+}
+
+
+/*! Create the directory of the disk cache. It is a subdirectory of dir named
+ * by srv_key().
+ * @return Returns 0 on success, or -1 on error.
+ */
+static int srv_mkdir(server_t *s, const char *dir)
+{
+   size_t len = strlen(dir) + 10;
+
+   if ((s->dir = malloc(len)) == NULL)
+   {
+      perror("malloc()");
+      return -1;
+   }
+   snprintf(s->dir, len, "%s/%08x", dir, srv_key(s));
+   if ((mkdir(dir, 0755) == -1 && errno != EEXIST) || (mkdir(s->dir, 0755) == -1 && errno != EEXIST)
+         || access(s->dir, W_OK) == -1)
+   {
+      fprintf(stderr, "cannot create cache directory %s: %s\n", s->dir, strerror(errno));
+      return -1;
+   }
+   return 0;
+}
+
+
+/*! Return the path of a tile in the disk cache.
+ */
+static void srv_path(const server_t *s, char *buf, size_t size, int c, int z, int x, int y)
+{
+   snprintf(buf, size, "%s/%d/%d/%d/%d.png", s->dir, c, z, x, y);
+}
+
+
+/*! Store a PNG in the disk cache. It is written into a temporary file first
+ * which is renamed, thus readers never see incomplete files.
+ */
+static void srv_store(const server_t *s, const srv_png_t *p, int c, int z, int x, int y)
+{
+   char path[1024], tmp[1100];
+   FILE *f;
+
+   srv_path(s, path, sizeof(path), c, z, x, y);
+   // create the directories
+   for (char *d = strchr(path + strlen(s->dir) + 1, '/'); d != NULL; d = strchr(d + 1, '/'))
+   {
+      *d = '\0';
+      if (mkdir(path, 0755) == -1 && errno != EEXIST)
+      {
+         perror("mkdir()");
+         return;
+      }
+      *d = '/';
+   }
+
+   snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long) pthread_self());
+   if ((f = fopen(tmp, "w")) == NULL)
+   {
+      fprintf(stderr, "failed to open file %s\n", tmp);
+      return;
+   }
+   if (fwrite(p->buf, p->len, 1, f) != 1 || fclose(f) == EOF || rename(tmp, path) == -1)
+   {
+      perror("srv_store()");
+      unlink(tmp);
+   }
+}
+
+
+/*! Return the PNG of a tile in color set c. It is encoded if necessary.
+ */
+static const srv_png_t *srv_png(server_t *s, srv_tile_t *t, int c)
+{
+   srv_png_t p;
+
+   pthread_mutex_lock(&s->mutex);
+   if (t->png[c].buf != NULL)
+   {
+      pthread_mutex_unlock(&s->mutex);
+      return &t->png[c];
+   }
+   pthread_mutex_unlock(&s->mutex);
+
+   if (t->image == NULL || srv_encode(&p, t->image, s->palette[c]) == -1)
+      return NULL;
+
+   if (s->dir != NULL)
+      srv_store(s, &p, c, t->z, t->x, t->y);
+
+   pthread_mutex_lock(&s->mutex);
+   if (t->png[c].buf == NULL)
+      t->png[c] = p;
+   else
+      free(p.buf);
+   pthread_mutex_unlock(&s->mutex);
+
+   return &t->png[c];
+}
+
+
+/*! Read a tile from the disk cache.
+ * @return Returns 0 if the tile was found, otherwise -1.
+ */
+static int srv_load(const server_t *s, srv_png_t *p, int c, int z, int x, int y)
+{
+   char path[1024];
+   struct stat st;
+   FILE *f;
+
+   srv_path(s, path, sizeof(path), c, z, x, y);
+   if ((f = fopen(path, "r")) == NULL)
+      return -1;
+
+   memset(p, 0, sizeof(*p));
+   if (fstat(fileno(f), &st) == -1 || (p->buf = malloc(st.st_size)) == NULL ||
+         fread(p->buf, st.st_size, 1, f) != 1)
+   {
+      free(p->buf);
+      fclose(f);
+      return -1;
+   }
+   p->len = p->size = st.st_size;
+
+   fclose(f);
+   return 0;
+}
+
+
+/*! Queue the neighbours of a tile for prefetching. Tiles which do not fit into
+ * the queue are dropped.
+ */
+static void srv_prefetch(server_t *s, int z, int x, int y)
+{
+   int n = 1 << z;
+
+   pthread_mutex_lock(&s->mutex);
+   for (int j = -1; j <= 1; j++)
+      for (int i = -1; i <= 1; i++)
+      {
+         if ((!i && !j) || x + i < 0 || x + i >= n || y + j < 0 || y + j >= n ||
+               (s->ptail + 1) % SRV_PREFETCH == s->phead || srv_find(s, z, x + i, y + j) != NULL)
+            continue;
+         s->pq[s->ptail][0] = z;
+         s->pq[s->ptail][1] = x + i;
+         s->pq[s->ptail][2] = y + j;
+         s->ptail = (s->ptail + 1) % SRV_PREFETCH;
+      }
+   pthread_cond_signal(&s->pcond);
+   pthread_mutex_unlock(&s->mutex);
+}
+
+
+/*! Calculate a tile of the prefetch queue. The mutex must be locked, it is
+ * unlocked on return.
+ */
+static void srv_prefetch_tile(server_t *s)
+{
+   srv_tile_t *t;
+   int z, x, y;
+
+   z = s->pq[s->phead][0];
+   x = s->pq[s->phead][1];
+   y = s->pq[s->phead][2];
+   s->phead = (s->phead + 1) % SRV_PREFETCH;
+   t = srv_find(s, z, x, y);
+   pthread_mutex_unlock(&s->mutex);
+
+   if (t == NULL && (t = srv_get(s, z, x, y, 1)) != NULL)
+      srv_put(s, t);
+}
+
+
+/*! Write a buffer completely to a socket.
+ */
+static int srv_send(int fd, const void *buf, size_t len)
+{
+   ssize_t n;
+
+   for (; len > 0; len -= n, buf = (const char*) buf + n)
+      if ((n = write(fd, buf, len)) <= 0)
+      {
+         if (n == -1 && errno == EINTR)
+         {
+            n = 0;
+            continue;
+         }
+         return -1;
+      }
+   return 0;
+}
+
+
+static void srv_reply(int fd, int status, const char *msg, const srv_png_t *p)
+{
+   char hdr[256];
+
+   snprintf(hdr, sizeof(hdr), "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+         status, msg, p != NULL ? "image/png" : "text/plain", p != NULL ? p->len : strlen(msg));
+   if (srv_send(fd, hdr, strlen(hdr)) == -1)
+      return;
+   if (p != NULL)
+      srv_send(fd, p->buf, p->len);
+   else
+      srv_send(fd, msg, strlen(msg));
+}
+
+
+/*! Handle the request of a connection.
+ */
+static void srv_conn(server_t *s, int fd)
+{
+   const srv_png_t *png;
+   srv_tile_t *t;
+   srv_png_t dp;
+   char buf[4096], *q;
+   int len = 0, n, z, x, y, c = 0;
+
+   // read the request header
+   while (len < (int) sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0)
+   {
+      len += n;
+      buf[len] = '\0';
+      if (strstr(buf, "\r\n\r\n") != NULL || strstr(buf, "\n\n") != NULL)
+         break;
+   }
+   buf[len] = '\0';
+
+   if (sscanf(buf, "GET /%d/%d/%d.png", &z, &x, &y) != 3 || z < 0 || z > SRV_MAXZOOM ||
+         x < 0 || x >= 1 << z || y < 0 || y >= 1 << z)
+   {
+      srv_reply(fd, 404, "Not Found", NULL);
+      goto srv_conn_exit;
+   }
+   if ((q = strstr(buf, "?c=")) != NULL && q < strstr(buf, " HTTP"))
+      c = atoi(q + 3);
+   if (c < 0 || c >= NUM_COLSET)
+      c = 0;
+
+   // the memory cache is looked up first, the disk cache only for tiles which are not in memory
+   if ((t = srv_get(s, z, x, y, 0)) == NULL && s->dir != NULL && !srv_load(s, &dp, c, z, x, y))
+   {
+      srv_reply(fd, 200, "OK", &dp);
+      free(dp.buf);
+   }
+   else if (t != NULL || (t = srv_get(s, z, x, y, 1)) != NULL)
+   {
+      if ((png = srv_png(s, t, c)) != NULL)
+         srv_reply(fd, 200, "OK", png);
+      else
+         srv_reply(fd, 500, "Internal Server Error", NULL);
+      srv_put(s, t);
+   }
+   else
+      srv_reply(fd, 500, "Internal Server Error", NULL);
+
+   srv_prefetch(s, z, x, y);
+
+srv_conn_exit:
+   close(fd);
+}
+
+
+/*! Worker thread, it handles the queued connections. If there are none, it
+ * calculates the tiles of the prefetch queue.
+ */
+static void *srv_worker(void *p)
+{
+   server_t *s = p;
+   int fd;
+
+   param_set(&s->param);
+   for (;;)
+   {
+      pthread_mutex_lock(&s->mutex);
+      while (s->chead == s->ctail && s->phead == s->ptail)
+         pthread_cond_wait(&s->pcond, &s->mutex);
+
+      if (s->chead == s->ctail)
+      {
+         srv_prefetch_tile(s);
+         continue;
+      }
+
+      fd = s->cq[s->chead];
+      s->chead = (s->chead + 1) % SRV_CONNQ;
+      pthread_cond_signal(&s->ccond);
+      pthread_mutex_unlock(&s->mutex);
+
+      srv_conn(s, fd);
+   }
+
+   return NULL;
+}
+
+
+/*! Run the tile server. This function returns only on error.
+ * @param addr Address to listen on, see srv_socket().
+ * @param bbox Bbox of zoom level 0 (realmin, imagmin, realmax, imagmax).
+ * @param dir Directory of the disk cache or NULL.
+ * @param maxtiles Number of tiles kept in memory.
+ * @param nthreads Number of worker threads.
+ * @return Returns -1 on error.
+ */
+int server_run(const char *addr, const double *bbox, const char *dir, int maxtiles, int nthreads)
+{
+   struct timeval tv = {.tv_sec = SRV_TIMEOUT};
+   pthread_t th;
+   server_t s;
+   int fd, cfd;
+
+   memset(&s, 0, sizeof(s));
+   s.maxtiles = maxtiles > 0 ? maxtiles : 1;
+   s.hsize = 2 * s.maxtiles + 1;
+   memcpy(s.bbox, bbox, sizeof(s.bbox));
+   param_get(&s.param);
+
+   if (dir != NULL && srv_mkdir(&s, dir) == -1)
+      return -1;
+
+   if ((s.hash = calloc(s.hsize, sizeof(*s.hash))) == NULL)
+   {
+      perror("calloc()");
+      return -1;
+   }
+   for (int i = 0; i < NUM_COLSET; i++)
+      if ((s.palette[i] = palette_create(i)) == NULL)
+         return -1;
+
+   if ((fd = srv_socket(addr, 1)) == -1)
+      return -1;
+
+   signal(SIGPIPE, SIG_IGN);
+   pthread_mutex_init(&s.mutex, NULL);
+   pthread_cond_init(&s.cond, NULL);
+   pthread_cond_init(&s.pcond, NULL);
+   pthread_cond_init(&s.ccond, NULL);
+   for (int i = 0; i < (nthreads > 0 ? nthreads : 1); i++)
+   {
+      if (pthread_create(&th, NULL, srv_worker, &s))
+      {
+         perror("pthread_create()");
+         return -1;
+      }
+      pthread_detach(th);
+   }
+
+   for (;;)
+   {
+      if ((cfd = accept(fd, NULL, NULL)) == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         perror("accept()");
+         break;
+      }
+
+      // a slow client must not block a worker
+      setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+      // if the queue is full, further connections wait in the listen backlog
+      pthread_mutex_lock(&s.mutex);
+      while ((s.ctail + 1) % SRV_CONNQ == s.chead)
+         pthread_cond_wait(&s.ccond, &s.mutex);
+      s.cq[s.ctail] = cfd;
+      s.ctail = (s.ctail + 1) % SRV_CONNQ;
+      pthread_cond_signal(&s.pcond);
+      pthread_mutex_unlock(&s.mutex);
+   }
+
+   close(fd);
+   return -1;
+}
+
+#else
+
+int server_run(const char *addr, const double *bbox, const char *dir, int maxtiles, int nthreads)
+{
+   fprintf(stderr, "thread support not compiled\n");
+   return -1;
+}
+
+#endif
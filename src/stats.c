@@ -0,0 +1,181 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file stats.c
+ * This file contains the optional instrumentation of the hot path (compiled
+ * in with WITH_STATS). Every thread counts into its own slot which is aligned
+ * to a cache line, thus the threads never share a line and the counters need
+ * no locking. mand_calc() records the number of pixels, the number of
+ * iterations, the pixels which reach maxiterate_ and a histogram of the escape
+ * counts. The phases compute, colorize, encode and write are timed with the
+ * monotonic clock. The report is written to stderr or as JSON to a file.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "intfract.h"
+
+#ifdef WITH_STATS
+
+//! counters of a thread, padded to a cache line
+typedef struct fract_stat
+{
+   uint64_t pixels, iterations, maxiter;
+   //! escape counts, bucket b contains the counts from 2^(b-1) to 2^b - 1
+   uint64_t hist[STAT_HIST];
+   double phase[NUM_PHASE];
+} __attribute__((aligned(64))) fract_stat_t;
+
+//! slots of the callers, the threads of the pool and the writer thread
+static fract_stat_t stats_[STAT_IO + 1];
+//! slot of the current thread
+static __thread fract_stat_t *stat_ = &stats_[0];
+
+static const char *phase_name_[] = {"compute", "colorize", "encode", "write"};
+
+
+/*! Select the slot of the current thread. Each thread of the pool has its
+ * own slot, thus concurrent jobs never count into the same one.
+ * @param idx 1 + pool_self() for a thread of the pool, or STAT_IO.
+ */
+void stat_thread(int idx)
+{
+   stat_ = &stats_[idx >= 0 && idx <= STAT_IO ? idx : 0];
+}
+
+
+/*! Return monotonic time in seconds.
+ */
+double stat_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*! Add time to a phase of the current thread.
+ */
+void stat_phase(int phase, double t)
+{
+   stat_->phase[phase] += t;
+}
+
+
+/*! Count calculated pixels.
+ * @param cnt Array of iteration counts.
+ * @param n Number of pixels.
+ */
+void stat_count(const int *cnt, int n)
+{
+   fract_stat_t *s = stat_;
+   uint64_t it = 0;
+
+   for (int i = 0; i < n; i++)
+   {
+      it += cnt[i];
+      if (cnt[i] >= maxiterate_)
+         s->maxiter++;
+      else
+         s->hist[cnt[i] ? 32 - __builtin_clz(cnt[i]) : 0]++;
+   }
+   s->pixels += n;
+   s->iterations += it;
+}
+
+
+/*! Print the statistics.
+ * @param s Name of the JSON file, or NULL for a text report to stderr.
+ */
+void stat_report(const char *s)
+{
+   fract_stat_t sum;
+   FILE *f = stderr;
+   int i, j, n, first = 1;
+
+   memset(&sum, 0, sizeof(sum));
+   for (i = 0; i <= STAT_IO; i++)
+   {
+      // the write time is subtracted from the encode time, avoid rounding below 0
+      if (stats_[i].phase[PHASE_ENCODE] < 0)
+         stats_[i].phase[PHASE_ENCODE] = 0;
+      sum.pixels += stats_[i].pixels;
+      sum.iterations += stats_[i].iterations;
+      sum.maxiter += stats_[i].maxiter;
+      for (j = 0; j < STAT_HIST; j++)
+         sum.hist[j] += stats_[i].hist[j];
+      for (j = 0; j < NUM_PHASE; j++)
+         sum.phase[j] += stats_[i].phase[j];
+   }
+   // the last used bucket of the histogram
+   for (n = STAT_HIST; n > 0 && !sum.hist[n - 1]; n--);
+
+   if (s != NULL && (f = fopen(s, "w")) == NULL)
+   {
+      fprintf(stderr, "failed to open file %s\n", s);
+      return;
+   }
+
+   if (s == NULL)
+   {
+      for (i = 0; i <= STAT_IO; i++)
+      {
+         if (!stats_[i].pixels && !stats_[i].phase[PHASE_COMPUTE] && !stats_[i].phase[PHASE_WRITE])
+            continue;
+         fprintf(f, "%s %2d: %10lu pixels, %13lu iterations, %9lu maxiter",
+               i == STAT_IO ? "writer" : "thread", i == STAT_IO ? 0 : i, stats_[i].pixels, stats_[i].iterations, stats_[i].maxiter);
+         for (j = 0; j < NUM_PHASE; j++)
+            fprintf(f, ", %s %.3fs", phase_name_[j], stats_[i].phase[j]);
+         fprintf(f, "\n");
+      }
+      fprintf(f, "total    : %10lu pixels, %13lu iterations, %9lu maxiter", sum.pixels, sum.iterations, sum.maxiter);
+      for (j = 0; j < NUM_PHASE; j++)
+         fprintf(f, ", %s %.3fs", phase_name_[j], sum.phase[j]);
+      fprintf(f, "\nescape histogram:");
+      for (j = 0; j < n; j++)
+         fprintf(f, " [%u-%u] %lu", j ? 1u << (j - 1) : 0, j ? (1u << j) - 1 : 0, sum.hist[j]);
+      fprintf(f, "\n");
+      return;
+   }
+
+   fprintf(f, "{\n  \"threads\": [");
+   for (i = 0; i <= STAT_IO; i++)
+   {
+      if (!stats_[i].pixels && !stats_[i].phase[PHASE_COMPUTE] && !stats_[i].phase[PHASE_WRITE])
+         continue;
+      fprintf(f, "%s\n    {\"thread\": %d, \"pixels\": %lu, \"iterations\": %lu, \"maxiter\": %lu",
+            first ? "" : ",", i == STAT_IO ? -1 : i, stats_[i].pixels, stats_[i].iterations, stats_[i].maxiter);
+      for (j = 0; j < NUM_PHASE; j++)
+         fprintf(f, ", \"%s_s\": %.6f", phase_name_[j], stats_[i].phase[j]);
+      fprintf(f, "}");
+      first = 0;
+   }
+   fprintf(f, "\n  ],\n  \"pixels\": %lu,\n  \"iterations\": %lu,\n  \"maxiter\": %lu,\n", sum.pixels, sum.iterations, sum.maxiter);
+   for (j = 0; j < NUM_PHASE; j++)
+      fprintf(f, "  \"%s_s\": %.6f,\n", phase_name_[j], sum.phase[j]);
+   fprintf(f, "  \"histogram\": [");
+   for (j = 0; j < n; j++)
+      fprintf(f, "%s%lu", j ? ", " : "", sum.hist[j]);
+   fprintf(f, "]\n}\n");
+   fclose(f);
+}
+
+#endif
@@ -0,0 +1,307 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file stream.c
+ * This file contains the streaming mode for huge images. The image is
+ * calculated in horizontal bands which are colored and written row by row
+ * with libpng. There are two band buffers: while one band is written by the
+ * writer thread the next one is calculated. Thus the memory is bounded by two
+ * bands independently of the height of the image.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+
+#include "intfract.h"
+
+
+struct stream
+{
+   FILE *f;
+   png_structp png;
+   png_infop info;
+   //! buffer for one row of RGB data
+   png_bytep row;
+   //! band which is currently written and its number of rows
+   const int *band;
+   int rows, hres;
+   //! set to 1 if an error occurred in libpng
+   int err;
+#ifdef WITH_THREADS
+   pthread_t thread;
+   //! render parameters of the writer thread, see param_get()
+   fract_param_t param;
+   //! set to 1 if the writer thread is running
+   int busy;
+#endif
+};
+
+
+/*! Write callback of libpng.
+ */
+static void stream_png_write(png_structp png, png_bytep data, png_size_t length)
+{
+   STAT_BEGIN(t);
+   if (fwrite(data, length, 1, png_get_io_ptr(png)) != 1)
+      png_error(png, "fwrite() failed");
+   STAT_WRITE(t);
+}
+
+
+/*! Flush callback of libpng.
+ */
+static void stream_png_flush(png_structp png)
+{
+   fflush(png_get_io_ptr(png));
+}
+
+
+/*! Color the rows of a band and write them to the PNG file.
+ * @param p Pointer to stream_t.
+ */
+static void *stream_write(void *p)
+{
+   stream_t *s = p;
+   const int *image = s->band;
+   int x, y, c;
+
+   if (setjmp(png_jmpbuf(s->png)))
+   {
+      s->err = 1;
+      return NULL;
+   }
+
+#ifdef WITH_THREADS
+   param_set(&s->param);
+#endif
+   STAT_THREAD(STAT_IO);
+   for (y = 0; y < s->rows; y++)
+   {
+      STAT_BEGIN(t);
+      for (x = 0; x < s->hres; x++, image++)
+      {
+         c = palette_[*image];
+         s->row[3 * x] = c >> 16;
+         s->row[3 * x + 1] = c >> 8;
+         s->row[3 * x + 2] = c;
+      }
+      STAT_END(PHASE_COLOR, t);
+
+      STAT_BEGIN(te);
+      png_write_row(s->png, s->row);
+      STAT_END(PHASE_ENCODE, te);
+   }
+
+   return NULL;
+}
+
+
+/*! Wait for the writer thread to finish its band.
+ */
+static void stream_wait(stream_t *s)
+{
+#ifdef WITH_THREADS
+   if (s->busy)
+   {
+      pthread_join(s->thread, NULL);
+      s->busy = 0;
+   }
+#endif
+}
+
+
+/*! Open a PNG file for writing band by band.
+ * @param s Name of the output file, "-" for stdout.
+ * @param hres Width of the image.
+ * @param vres Height of the image.
+ * @return Returns a pointer to the stream or NULL in case of error.
+ */
+stream_t *stream_open(const char *s, int hres, int vres)
+{
+   stream_t *st;
+
+   if ((st = calloc(1, sizeof(*st))) == NULL)
+   {
+      perror("calloc()");
+      return NULL;
+   }
+   st->hres = hres;
+
+   if (!strcmp(s, "-"))
+   {
+      st->f = stdout;
+   }
+   else if ((st->f = fopen(s, "w")) == NULL)
+   {
+      fprintf(stderr, "failed to open file %s\n", s);
+      free(st);
+      return NULL;
+   }
+
+   if ((st->row = malloc(hres * 3)) == NULL)
+   {
+      perror("malloc()");
+      goto stream_open_err;
+   }
+
+   if ((st->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL)) == NULL ||
+         (st->info = png_create_info_struct(st->png)) == NULL)
+   {
+      fprintf(stderr, "failed to initialize libpng\n");
+      goto stream_open_err;
+   }
+
+   if (setjmp(png_jmpbuf(st->png)))
+   {
+      fprintf(stderr, "failed to write PNG\n");
+      goto stream_open_err;
+   }
+
+   png_set_write_fn(st->png, st->f, stream_png_write, stream_png_flush);
+   png_set_IHDR(st->png, st->info, hres, vres, 8, PNG_COLOR_TYPE_RGB,
+         PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+   png_write_info(st->png, st->info);
+
+   return st;
+
+stream_open_err:
+   st->err = 1;
+   stream_close(st);
+   return NULL;
+}
+
+
+/*! Write the next band of the image. The band is colored and written in the
+ * background, thus its buffer must not be changed until the next call of
+ * stream_put() or stream_close().
+ * @param st Pointer to the stream.
+ * @param band Iteration counts of the band, the first row is the next row of
+ * the PNG image.
+ * @param rows Number of rows of the band.
+ * @return Returns 0 on success, or -1 if an error occurred.
+ */
+int stream_put(stream_t *st, const int *band, int rows)
+{
+   stream_wait(st);
+   if (st->err)
+      return -1;
+
+   st->band = band;
+   st->rows = rows;
+#ifdef WITH_THREADS
+   param_get(&st->param);
+   if (!pthread_create(&st->thread, NULL, stream_write, st))
+      st->busy = 1;
+   else
+#endif
+      stream_write(st);
+
+   return 0;
+}
+
+
+/*! Finish the PNG file and free the stream.
+ * @param st Pointer to the stream.
+ * @return Returns 0 on success, or -1 if an error occurred.
+ */
+int stream_close(stream_t *st)
+{
+   int ret = -1;
+
+   stream_wait(st);
+   if (!st->err)
+   {
+      if (setjmp(png_jmpbuf(st->png)))
+         st->err = 1;
+      else
+      {
+         STAT_BEGIN(t);
+         png_write_end(st->png, NULL);
+         STAT_END(PHASE_ENCODE, t);
+         ret = 0;
+      }
+   }
+   if (st->err)
+      fprintf(stderr, "failed to write PNG\n");
+
+   if (st->png != NULL)
+      png_destroy_write_struct(&st->png, &st->info);
+   free(st->row);
+   if (st->f != stdout)
+      fclose(st->f);
+   else
+      fflush(st->f);
+   free(st);
+
+   return ret;
+}
+
+
+/*! Calculate the image band by band and write it to a PNG file.
+ * @param v Pointer to the view. The member image is overwritten.
+ * @param band Height of a band in rows.
+ * @param nthreads Number of threads to use for the calculation.
+ * @param s Name of the output file, "-" for stdout.
+ * @return Returns 0 on success, or -1 on error.
+ */
+int stream_render(fract_view_t *v, int band, int nthreads, const char *s)
+{
+   stream_t *st;
+   int *buf[2] = {NULL, NULL};
+   int r0, r1, k, ret = -1;
+
+   if (band < 1)
+      band = TILE_SIZE;
+   if (band > v->vres)
+      band = v->vres;
+
+   if ((st = stream_open(s, v->hres, v->vres)) == NULL)
+      return -1;
+
+   if ((buf[0] = malloc(v->hres * band * sizeof(**buf))) == NULL ||
+         (buf[1] = malloc(v->hres * band * sizeof(**buf))) == NULL)
+   {
+      perror("malloc()");
+      stream_close(st);
+      goto stream_exit;
+   }
+
+   // PNG rows r0 to r1 - 1 of the image, which are rows vres - r1 to vres - r0 - 1 of the view
+   for (r0 = 0, k = 0, ret = 0; r0 < v->vres && !ret; r0 = r1, k ^= 1)
+   {
+      r1 = r0 + band < v->vres ? r0 + band : v->vres;
+
+      // the image is stored bottom up, thus image row r0 is the first row of the buffer
+      v->image = buf[k] - v->hres * r0;
+      if (sched_render(v, v->vres - r1, v->vres - r0, nthreads) == -1)
+         ret = -1;
+      else
+         ret = stream_put(st, buf[k], r1 - r0);
+   }
+   if (stream_close(st))
+      ret = -1;
+
+stream_exit:
+   v->image = NULL;
+   free(buf[1]);
+   free(buf[0]);
+
+   return ret;
+}
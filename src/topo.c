@@ -0,0 +1,287 @@
+/* Copyright 2025 Bernhard R. Fischer, 4096R/8E24F29D <bf@abenteuerland.at>
+ *
+ * IntFract is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3 of the License.
+ *
+ * IntFract is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with IntFract. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* \file topo.c
+ * This file contains the functions which adapt the threads and the memory to
+ * the CPU topology. The number of CPUs is the number of CPUs of the affinity
+ * mask of the process, limited by the CPU quota of the cgroup, thus intfract
+ * does not start more threads than a container may run.
+ *
+ * On request (option -t) the threads of the pool are pinned to the CPUs of
+ * the affinity mask, the first hardware thread of each core comes first.
+ * Pinning is not the default because several processes, e.g. the local
+ * workers of -P or programs using libintfract, would all be pinned to the
+ * same CPUs. With pinning the scheduler gives each thread a contiguous band
+ * of tiles (see sched.c). Large image buffers are mapped but not touched
+ * before the render, thus their pages are placed on the NUMA node of the
+ * thread which writes the band first. They are aligned for transparent huge
+ * pages.
+ *
+ * @author Bernhard R. Fischer
+ * @version 2025/07/25
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "intfract.h"
+
+//! size of a huge page
+#define HUGE_PAGE (2 << 20)
+//! buffers of at least this size are aligned to huge pages
+#define HUGE_MIN (4 << 20)
+//! size of a page
+#define PAGE 4096
+
+
+#ifdef WITH_THREADS
+static pthread_once_t topo_once_ = PTHREAD_ONCE_INIT;
+#endif
+//! CPUs of the affinity mask, first hardware threads of the cores first
+static int topo_cpu_[CPU_SETSIZE];
+//! number of CPUs in topo_cpu_, 0 if unknown
+static int topo_ncpu_;
+//! 1 if the threads of the pool are pinned
+static int topo_affinity_;
+
+
+/*! Read the first number of a file.
+ * @return Returns the number, or -1 if the file could not be read.
+ */
+static long topo_read(const char *name)
+{
+   FILE *f;
+   long n;
+
+   if ((f = fopen(name, "r")) == NULL)
+      return -1;
+   if (fscanf(f, "%ld", &n) != 1)
+      n = -1;
+   fclose(f);
+   return n;
+}
+
+
+/*! Return the number of CPUs of the cgroup quota, rounded up.
+ * @return Returns the number of CPUs, or 0 if there is no quota.
+ */
+static int topo_quota(void)
+{
+   long quota, period;
+   FILE *f;
+
+   // cgroup v2: "<quota> <period>" or "max <period>"
+   if ((f = fopen("/sys/fs/cgroup/cpu.max", "r")) != NULL)
+   {
+      if (fscanf(f, "%ld %ld", &quota, &period) != 2)
+         quota = -1;
+      fclose(f);
+   }
+   // cgroup v1
+   else if ((quota = topo_read("/sys/fs/cgroup/cpu/cpu.cfs_quota_us")) > 0)
+      period = topo_read("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+   else if ((quota = topo_read("/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_quota_us")) > 0)
+      period = topo_read("/sys/fs/cgroup/cpu,cpuacct/cpu.cfs_period_us");
+
+   if (quota <= 0 || period <= 0)
+      return 0;
+   return (quota + period - 1) / period;
+}
+
+
+/*! Test if a CPU is the first hardware thread of its core.
+ */
+static int topo_primary(int cpu)
+{
+   char name[80];
+
+   snprintf(name, sizeof(name), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+   long first = topo_read(name);
+   return first == -1 || first == cpu;
+}
+
+
+/*! Read the CPUs of the affinity mask of the process.
+ */
+static void topo_init(void)
+{
+   cpu_set_t set;
+   int i, pass;
+
+   if (sched_getaffinity(0, sizeof(set), &set) == -1)
+   {
+      perror("sched_getaffinity()");
+      return;
+   }
+
+   // the second hardware threads of the cores are used last
+   for (pass = 0; pass < 2; pass++)
+      for (i = 0; i < CPU_SETSIZE; i++)
+         if (CPU_ISSET(i, &set) && topo_primary(i) == !pass)
+            topo_cpu_[topo_ncpu_++] = i;
+}
+
+
+/*! Read the CPUs once.
+ */
+static void topo_get(void)
+{
+#ifdef WITH_THREADS
+   pthread_once(&topo_once_, topo_init);
+#else
+   if (!topo_ncpu_)
+      topo_init();
+#endif
+}
+
+
+/*! This function returns the number of CPUs which the process may use. This
+ * is the number of CPUs of its affinity mask, or of /proc/cpuinfo if it is
+ * unknown, limited by the CPU quota of the cgroup.
+ * @return The function returns the number of CPUs, or -1 if it is unknown.
+ */
+int get_ncpu(void)
+{
+   char buf[1024];
+   FILE *cpuinfo;
+   int n, quota;
+
+   topo_get();
+   if (!(n = topo_ncpu_))
+   {
+      if ((cpuinfo = fopen("/proc/cpuinfo", "r")) == NULL)
+         return -1;
+
+      while (fgets(buf, sizeof(buf), cpuinfo) != NULL)
+         if (!strncmp(buf, "processor", 9))
+            n++;
+      fclose(cpuinfo);
+   }
+
+   if ((quota = topo_quota()) > 0 && (quota < n || !n))
+      n = quota;
+
+   return n ? n : -1;
+}
+
+
+/*! Enable pinning of the threads of the pool. It must be called before the
+ * first render, because the threads are pinned when they are created.
+ * @return Returns 0 on success, or -1 if it is not supported.
+ */
+int topo_affinity(void)
+{
+#ifdef WITH_AFFINITY
+   topo_get();
+   if (topo_ncpu_)
+   {
+      topo_affinity_ = 1;
+      return 0;
+   }
+#endif
+   fprintf(stderr, "thread affinity not supported\n");
+   return -1;
+}
+
+
+/*! Return 1 if the threads of the pool are pinned, otherwise 0.
+ */
+int topo_pinned(void)
+{
+   return topo_affinity_;
+}
+
+
+/*! Pin the calling thread to a CPU of the affinity mask of the process if
+ * pinning is enabled (see topo_affinity()). This is called by the threads of
+ * the pool.
+ * @param idx Index of the thread, it is pinned to CPU number idx modulo the
+ * number of CPUs.
+ */
+void topo_pin(int idx)
+{
+#ifdef WITH_AFFINITY
+   cpu_set_t set;
+
+   if (!topo_affinity_)
+      return;
+
+   CPU_ZERO(&set);
+   CPU_SET(topo_cpu_[idx % topo_ncpu_], &set);
+   if (sched_setaffinity(0, sizeof(set), &set) == -1)
+      perror("sched_setaffinity()");
+#endif
+}
+
+
+/*! Allocate an image buffer which is filled with 0. Buffers of at least
+ * HUGE_MIN bytes are mapped aligned to huge pages and transparent huge pages
+ * are requested for them. Their pages are not touched, thus each one is
+ * placed on the NUMA node of the thread which writes it first.
+ * @param size Size of the buffer in bytes.
+ * @return Returns a pointer to the buffer which must be freed with
+ * topo_free(), or NULL on error.
+ */
+void *topo_alloc(size_t size)
+{
+   size_t len, head;
+   char *buf;
+
+   if (size < HUGE_MIN)
+   {
+      if ((buf = calloc(1, size)) == NULL)
+         perror("calloc()");
+      return buf;
+   }
+
+   // map a huge page more and unmap the unaligned parts
+   size = (size + PAGE - 1) & ~(size_t) (PAGE - 1);
+   len = size + HUGE_PAGE;
+   if ((buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+   {
+      perror("mmap()");
+      return NULL;
+   }
+   head = (HUGE_PAGE - (uintptr_t) buf % HUGE_PAGE) % HUGE_PAGE;
+   if (head)
+      munmap(buf, head);
+   munmap(buf + head + size, len - head - size);
+   buf += head;
+
+#ifdef MADV_HUGEPAGE
+   // this is only a hint, it fails if THP is not supported
+   madvise(buf, size, MADV_HUGEPAGE);
+#endif
+
+   return buf;
+}
+
+
+/*! Free a buffer of topo_alloc().
+ * @param buf Pointer to the buffer, may be NULL.
+ * @param size Size of the buffer as passed to topo_alloc().
+ */
+void topo_free(void *buf, size_t size)
+{
+   if (size < HUGE_MIN)
+      free(buf);
+   else if (buf != NULL)
+      munmap(buf, (size + PAGE - 1) & ~(size_t) (PAGE - 1));
+}